@@ -11,6 +11,7 @@ static CVCHIQSoundBaseDevice m_VCHIQSound;
 __attribute__((visibility("default")))
 bool AMPiInitialize(unsigned nSampleRate, unsigned nChunkSize)
 {
+    if (nSampleRate < 44100 || nSampleRate > 48000) return false;
     if (!CVCHIQDevice_Initialize(&m_VCHIQ)) return false;
 
     CVCHIQSoundBaseDevice_Ctor(&m_VCHIQSound, &m_VCHIQ,
@@ -24,6 +25,49 @@ void AMPiSetChunkCallback(chunk_cb_t Callback)
     m_VCHIQSound.ChunkCallback = Callback;
 }
 
+__attribute__((visibility("default")))
+void AMPiSetChunkSize(unsigned nChunkSize)
+{
+    CVCHIQSoundBaseDevice_SetChunkSize(&m_VCHIQSound, nChunkSize);
+}
+
+__attribute__((visibility("default")))
+unsigned AMPiGetQueuedBytes()
+{
+    return CVCHIQSoundBaseDevice_GetQueuedBytes(&m_VCHIQSound);
+}
+
+__attribute__((visibility("default")))
+void AMPiSetBulkTransfer(bool bEnable)
+{
+    m_VCHIQSound.m_bBulk = bEnable;
+}
+
+__attribute__((visibility("default")))
+void AMPiSetBatchedMessages(bool bEnable)
+{
+    m_VCHIQSound.m_bBatch = bEnable;
+}
+
+__attribute__((visibility("default")))
+void AMPiGetSubmitStats(AMPiSubmitPath Path, AMPiSubmitStats *pStats)
+{
+    static const enum TVCHIQSoundSubmitPath Paths[] =
+    {
+        VCHIQSoundSubmitMessages,
+        VCHIQSoundSubmitBatched,
+        VCHIQSoundSubmitBulk
+    };
+
+    TVCHIQSoundSubmitStats Stats;
+    CVCHIQSoundBaseDevice_GetSubmitStats(&m_VCHIQSound, Paths[Path], &Stats);
+
+    pStats->nChunks = Stats.nChunks;
+    pStats->nMicros = Stats.nMicros;
+    pStats->nMessages = Stats.nMessages;
+    pStats->nDoorbells = Stats.nDoorbells;
+}
+
 __attribute__((visibility("default")))
 bool AMPiStart()
 {
@@ -42,8 +86,46 @@ bool AMPiIsActive()
     return CVCHIQSoundBaseDevice_IsActive(&m_VCHIQSound);
 }
 
+__attribute__((visibility("default")))
+void AMPiGetStats(AMPiStats *pStats)
+{
+    TVCHIQSoundStats Stats;
+    CVCHIQSoundBaseDevice_GetStats(&m_VCHIQSound, &Stats);
+
+    pStats->nQueuedBytes = Stats.nQueuedBytes;
+    pStats->nMinHeadroomBytes = Stats.nMinHeadroomBytes;
+    pStats->nUnderruns = Stats.nUnderruns;
+    pStats->nLateCompletions = Stats.nLateCompletions;
+    pStats->nCallbacks = Stats.nCallbacks;
+    pStats->nCallbackMinMicros = Stats.nCallbackMinMicros;
+    pStats->nCallbackAvgMicros = Stats.nCallbackAvgMicros;
+    pStats->nCallbackMaxMicros = Stats.nCallbackMaxMicros;
+}
+
+__attribute__((visibility("default")))
+void AMPiResetStats()
+{
+    CVCHIQSoundBaseDevice_ResetStats(&m_VCHIQSound);
+}
+
+__attribute__((visibility("default")))
+bool AMPiGetThreadStats(unsigned nThread, AMPiThreadStats *pStats)
+{
+    struct ampi_co_stats Stats;
+    if (nThread > MAX_CO || !ampi_co_get_stats(nThread, &Stats)) return false;
+
+    pStats->pState = ampi_co_state_name(Stats.state);
+    pStats->nSwitches = Stats.switches;
+    pStats->nRunMicros = Stats.run_us;
+    pStats->nMaxRunMicros = Stats.max_run_us;
+    pStats->nStackBytes = Stats.stack_size;
+    pStats->nStackUsedBytes = Stats.stack_used;
+    return true;
+}
+
 __attribute__((visibility("default")))
 void AMPiPoke()
 {
-    for (int i = 1; i <= MAX_CO; i++) ampi_co_next(i);
+    ampi_co_tick();
+    ampi_co_run_ready();
 }
@@ -9,6 +9,8 @@ extern "C" {
 #endif
 
 // Initialization
+// nSampleRate is the output rate in Hz, 44100 to 48000 (HDMI sinks usually
+// run at 48000). Returns false for rates outside that range
 bool AMPiInitialize(unsigned nSampleRate, unsigned nChunkSize);
 
 // The callback produces 16-bit interleaved stereo sample data.
@@ -20,16 +22,87 @@ bool AMPiInitialize(unsigned nSampleRate, unsigned nChunkSize);
 typedef unsigned (*chunk_cb_t) (int16_t **pBuffer, unsigned nChunkSize);
 void AMPiSetChunkCallback(chunk_cb_t Callback);
 
+// Changes the number of elements requested per callback. Takes effect from
+// the next chunk, so it can be called while audio is running.
+void AMPiSetChunkSize(unsigned nChunkSize);
+
+// Number of bytes handed to the VideoCore that it has not played yet.
+// From inside the chunk callback, this is what is left to play before
+// the chunk being produced is needed; 0 means the output has run dry.
+unsigned AMPiGetQueuedBytes();
+
+// Chooses how chunks reach the VideoCore, from the next chunk on. By
+// default they are copied into VCHIQ messages. With bulk transfers, the
+// VideoCore DMAs each chunk straight out of the buffer the callback
+// returned, so the callback must not write to that buffer again until
+// two more chunks have been requested after it.
+void AMPiSetBulkTransfer(bool bEnable);
+
+// When chunks are copied into messages, the write header and the data
+// packets of a chunk are queued together by default, with one slot
+// reservation and one doorbell. Disabling this queues them one by one.
+void AMPiSetBatchedMessages(bool bEnable);
+
+// What handing chunks to VCHIQ (after the callback returned) has cost
+// so far, totalled separately for each way of sending them.
+typedef enum AMPiSubmitPath
+{
+    AMPiSubmitMessages,
+    AMPiSubmitBatchedMessages,
+    AMPiSubmitBulk
+} AMPiSubmitPath;
+typedef struct AMPiSubmitStats
+{
+    unsigned nChunks;
+    unsigned nMicros;
+    unsigned nMessages;             // a bulk transfer counts as one
+    unsigned nDoorbells;            // rung on the VideoCore
+} AMPiSubmitStats;
+void AMPiGetSubmitStats(AMPiSubmitPath Path, AMPiSubmitStats *pStats);
+
 // As the names suggest
 bool AMPiStart();
 bool AMPiStop();
 bool AMPiIsActive();
 
+// Health of the output, from the last AMPiResetStats (or AMPiStart) on.
+// Safe to call from the main thread while audio is running.
+typedef struct AMPiStats
+{
+    unsigned nQueuedBytes;          // sent, but not played yet
+    unsigned nMinHeadroomBytes;     // least left queued when a chunk completed
+    unsigned nUnderruns;            // completions that left nothing queued
+    unsigned nLateCompletions;      // completions over 50% later than the audio they reported lasts
+    unsigned nCallbacks;
+    unsigned nCallbackMinMicros;    // time spent in the chunk callback
+    unsigned nCallbackAvgMicros;
+    unsigned nCallbackMaxMicros;
+} AMPiStats;
+void AMPiGetStats(AMPiStats *pStats);
+void AMPiResetStats();
+
+// What AMPi's internal thread 'nThread' (numbered from 1) is doing, how
+// much CPU time it has used since it was created and how deep its stack
+// has gone. Returns false past the last thread.
+typedef struct AMPiThreadStats
+{
+    const char *pState;             // "ready", "running", or what it waits for
+    unsigned nSwitches;             // times it was switched to
+    unsigned nRunMicros;            // total time it ran
+    unsigned nMaxRunMicros;         // longest it ran before switching away
+    unsigned nStackBytes;
+    unsigned nStackUsedBytes;       // high-water mark
+} AMPiThreadStats;
+bool AMPiGetThreadStats(unsigned nThread, AMPiThreadStats *pStats);
+
 // Call this periodically to keep audio running. Frequencies near
 // or above 100 Hz should cause no problem, but feel free to try
 // any other value.
 // This can be done either from a loop in the main thread, or from
 // an interrupt handler for a timer.
+// Audio itself is driven by the VideoCore's doorbell interrupt,
+// which runs the threads it wakes straight away; the poke only
+// serves timeouts and threads that poll.
 void AMPiPoke();
 
 #ifdef __cplusplus
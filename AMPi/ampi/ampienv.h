@@ -14,6 +14,11 @@ extern "C" {
 // Replace with #define to turn on multi-core support
 #undef ARM_ALLOW_MULTI_CORE
 
+// Frequency of the periodic handler (see RegisterPeriodicHandler)
+#ifndef AMPI_TICK_HZ
+#define AMPI_TICK_HZ 1000
+#endif
+
 // == Environment functions ==
 
 #include <stddef.h>
@@ -36,8 +41,12 @@ void ampi_assertion_failed (const char *pExpr, const char *pFile, unsigned nLine
 void MsDelay (unsigned nMilliSeconds);
 void usDelay (unsigned nMicroSeconds);
 
+// Free-running microsecond counter; only used for statistics.
+unsigned GetMicroseconds (void);
+
 // Called once. The handler passed here should be called with a
-// fixed frequency. 100 Hz is a reasonable value.
+// fixed frequency of AMPI_TICK_HZ, which is the resolution of
+// timers and timeouts.
 typedef void TPeriodicTimerHandler (void);
 void RegisterPeriodicHandler (TPeriodicTimerHandler *pHandler);
 
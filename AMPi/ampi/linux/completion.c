@@ -10,6 +10,8 @@ void complete (struct completion *x)
 #endif
 
 	x->done++;
+
+	ampi_co_wake (x);
 }
 
 void complete_all (struct completion *x)
@@ -19,6 +21,8 @@ void complete_all (struct completion *x)
 #endif
 
 	x->done = (unsigned) -1 / 2;
+
+	ampi_co_wake (x);
 }
 
 void wait_for_completion (struct completion *x)
@@ -27,10 +31,7 @@ void wait_for_completion (struct completion *x)
 	BUG_ON (CMultiCoreSupport::ThisCore () != 0);
 #endif
 
-	while (x->done == 0)
-	{
-		ampi_co_yield();
-	}
+	ampi_co_wait_until (x, AMPI_CO_WAIT_COMPLETION, x->done != 0);
 
 	x->done--;
 }
@@ -59,15 +60,12 @@ long wait_for_completion_interruptible_timeout (struct completion *x, unsigned l
 
 	unsigned long start = jiffies;
 
-	while (x->done == 0)
+	// the tick wakes us up once the timeout is due
+	ampi_co_wait_until_deadline (x, AMPI_CO_WAIT_COMPLETION, start+timeout,
+				     x->done != 0 || jiffies-start >= timeout);
+	if (x->done == 0)
 	{
-		unsigned long now = jiffies;
-		if (now-start >= timeout)
-		{
-			return 0;
-		}
-
-		ampi_co_yield();
+		return 0;
 	}
 
 	x->done--;
@@ -1,17 +1,44 @@
 #include "coroutine.h"
 #include <linux/printk.h>
+#include <linux/jiffies.h>
+#include <linux/synchronize.h>
+#include <ampienv.h>
 
 void (*callback)(int8_t) = 0;
 
-#define MAX_STACK   65536
+#define STACK_PAINT 0x5354434b  // "STCK"
 
 static uint32_t used = 0;
 static void (*fn_ptr[MAX_CO])(void *);
 static void *args[MAX_CO];
-static int8_t stack_space[MAX_CO][MAX_STACK];
+
+// Not zeroed at boot, as every stack is painted when it is handed out
+static uint32_t stack_pool[AMPI_CO_STACK_POOL / 4]
+    __attribute__ ((section (".noinit"), aligned (8)));
+static uint32_t pool_used = 0;      // in words
+static uint32_t *stack_base[MAX_CO];
+static uint32_t stack_words[MAX_CO];
 
 static int8_t current = 0;
 
+// Per thread scheduling state. A waiting thread writes its own entries;
+// wakers (possibly interrupt handlers) only move it to AMPI_CO_READY
+static volatile enum ampi_co_state status[MAX_CO];
+static const void *volatile wait_obj[MAX_CO];
+static volatile bool has_deadline[MAX_CO];
+static volatile unsigned long deadline[MAX_CO];
+static uint32_t switches[MAX_CO];
+static uint32_t run_us[MAX_CO];
+static uint32_t max_run_us[MAX_CO];
+
+// FIFO of ready threads; a thread is on it at most once, while its
+// status is AMPI_CO_READY. Only touched with interrupts disabled
+static int8_t ready_queue[MAX_CO];
+static unsigned ready_head = 0, ready_count = 0;
+
+// Set while ampi_co_run_ready() is running threads
+static volatile bool scheduling = false;
+
 struct reg_set {
     uint32_t r4;
     uint32_t r5;
@@ -49,28 +76,182 @@ void ampi_co_jump(struct reg_set *restore_regs, struct reg_set *branch_regs)
     );
 }
 
-int8_t ampi_co_create(void (*fn)(void *), void *arg)
+// The following helpers expect interrupts to be disabled
+
+static void make_ready(int id)
+{
+    status[id] = AMPI_CO_READY;
+    ready_queue[(ready_head + ready_count++) % MAX_CO] = id;
+}
+
+static void remove_ready(int id)
+{
+    unsigned n = 0;
+    for (unsigned i = 0; i < ready_count; i++) {
+        int8_t other = ready_queue[(ready_head + i) % MAX_CO];
+        if (other != id) ready_queue[(ready_head + n++) % MAX_CO] = other;
+    }
+    ready_count = n;
+}
+
+// Back to running without having been switched away from
+static void cancel_wait(int id)
+{
+    if (status[id] == AMPI_CO_READY) remove_ready(id);
+    status[id] = AMPI_CO_RUNNING;
+}
+
+static bool is_waiting(int id)
 {
-    printk("Creating: %x %x", fn, arg);
+    return status[id] >= AMPI_CO_WAIT_TICK;
+}
+
+int8_t ampi_co_create(void (*fn)(void *), void *arg, uint32_t stack_size)
+{
+    printk("Creating: %x %x, %d byte stack", fn, arg, stack_size);
+    // Keep every stack 8-byte aligned, as the ABI requires
+    uint32_t words = ((stack_size + 7) & ~7u) / 4;
+    if (words > AMPI_CO_STACK_POOL / 4 - pool_used) {
+        printk("Stack pool exhausted (%d of %d bytes used)",
+               pool_used * 4, AMPI_CO_STACK_POOL);
+        return 0;
+    }
     for (int i = 0; i < MAX_CO; i++)
         if (!(used & (1 << i))) {
             used |= (1 << i);
             fn_ptr[i] = fn;
             args[i] = arg;
+            stack_base[i] = &stack_pool[pool_used];
+            stack_words[i] = words;
+            pool_used += words;
+            for (uint32_t w = 0; w < words; w++) stack_base[i][w] = STACK_PAINT;
+            wait_obj[i] = 0;
+            has_deadline[i] = false;
+            switches[i] = run_us[i] = max_run_us[i] = 0;
+            linuxemu_EnterCritical();
+            make_ready(i);
+            linuxemu_LeaveCritical();
             return i + 1;
         }
     return 0;
 }
 
+static void switch_to_main()
+{
+    int8_t id = current - 1;
+    current = 0;
+    if (callback) callback(current);
+    ampi_co_jump(&regs[id], &main_regs);
+}
+
 void ampi_co_yield()
 {
     if (current > 0) {
-        int8_t id = current - 1;
-        current = 0;
-        if (callback) callback(current);
-        ampi_co_jump(&regs[id], &main_regs);
+        ampi_co_prepare_wait_deadline(0, AMPI_CO_WAIT_TICK, jiffies + 1);
+        ampi_co_wait();
+        ampi_co_finish_wait();
     } else {
-        for (int i = 1; i <= MAX_CO; i++) ampi_co_next(i);
+        ampi_co_run_ready();
+    }
+}
+
+void ampi_co_prepare_wait(const void *obj, enum ampi_co_state reason)
+{
+    // The main thread can't block; its waits run the ready threads instead
+    if (current == 0) return;
+    int8_t id = current - 1;
+    has_deadline[id] = false;
+    wait_obj[id] = obj;
+    // Wakers look at the object only once the status says it is waiting
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    status[id] = reason;
+    // Whatever the caller checks next must be read after this
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+void ampi_co_prepare_wait_deadline(const void *obj, enum ampi_co_state reason,
+                                   unsigned long when)
+{
+    if (current == 0) return;
+    int8_t id = current - 1;
+    wait_obj[id] = obj;
+    deadline[id] = when;
+    has_deadline[id] = true;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    status[id] = reason;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+void ampi_co_wait()
+{
+    if (current == 0) {
+        ampi_co_run_ready();
+        return;
+    }
+    int8_t id = current - 1;
+    linuxemu_EnterCritical();
+    if (status[id] == AMPI_CO_READY) {
+        // Woken since preparing
+        cancel_wait(id);
+        linuxemu_LeaveCritical();
+        return;
+    }
+    linuxemu_LeaveCritical();
+    // A wakeup from here on queues it, and the scheduler resumes it
+    switch_to_main();
+}
+
+void ampi_co_finish_wait()
+{
+    if (current == 0) return;
+    int8_t id = current - 1;
+    linuxemu_EnterCritical();
+    cancel_wait(id);
+    wait_obj[id] = 0;
+    has_deadline[id] = false;
+    linuxemu_LeaveCritical();
+}
+
+void ampi_co_wake(const void *obj)
+{
+    linuxemu_EnterCritical();
+    for (int i = 0; i < MAX_CO; i++)
+        if ((used & (1 << i)) && is_waiting(i) && wait_obj[i] == obj)
+            make_ready(i);
+    linuxemu_LeaveCritical();
+}
+
+void ampi_co_tick()
+{
+    unsigned long now = jiffies;
+    linuxemu_EnterCritical();
+    for (int i = 0; i < MAX_CO; i++)
+        if ((used & (1 << i)) && is_waiting(i) && has_deadline[i] &&
+            (long)(now - deadline[i]) >= 0)
+            make_ready(i);
+    linuxemu_LeaveCritical();
+}
+
+void ampi_co_run_ready()
+{
+    // Threads can't run threads, and an interrupt that arrives while
+    // they are being run leaves its wakeups to the loop below
+    if (scheduling || current != 0) return;
+    scheduling = true;
+    for (;;) {
+        linuxemu_EnterCritical();
+        if (ready_count == 0) {
+            // Cleared with interrupts off so no wakeup is left behind
+            scheduling = false;
+            linuxemu_LeaveCritical();
+            return;
+        }
+        int8_t id = ready_queue[ready_head];
+        ready_head = (ready_head + 1) % MAX_CO;
+        ready_count--;
+        status[id] = AMPI_CO_RUNNING;
+        linuxemu_LeaveCritical();
+        ampi_co_next(id + 1);
     }
 }
 
@@ -80,17 +261,55 @@ void ampi_co_next(int8_t id)
     if (!(used & (1 << id))) return;
     current = id + 1;
     if (callback) callback(current);
+    switches[id]++;
+    unsigned start = GetMicroseconds();
     if (regs[id].pc == 0) {
         // Initialization
         regs[id].pc = (uint32_t)fn_ptr[id];
-        regs[id].sp = (uint32_t)&stack_space[id + 1];
+        regs[id].sp = (uint32_t)(stack_base[id] + stack_words[id]);
         ampi_co_jump_arg(&main_regs, &regs[id], args[id]);
     } else {
         ampi_co_jump(&main_regs, &regs[id]);
     }
+    uint32_t elapsed = GetMicroseconds() - start;
+    run_us[id] += elapsed;
+    if (elapsed > max_run_us[id]) max_run_us[id] = elapsed;
 }
 
 void ampi_co_callback(void (*cb)(int8_t))
 {
     callback = cb;
 }
+
+bool ampi_co_get_stats(int8_t id, struct ampi_co_stats *stats)
+{
+    id--;
+    if (id < 0 || id >= MAX_CO || !(used & (1 << id))) return false;
+    stats->state = status[id];
+    stats->wait_obj = is_waiting(id) ? wait_obj[id] : 0;
+    stats->switches = switches[id];
+    stats->run_us = run_us[id];
+    stats->max_run_us = max_run_us[id];
+    // Stacks grow down, so the paint left at the bottom was never reached
+    uint32_t untouched = 0;
+    while (untouched < stack_words[id] && stack_base[id][untouched] == STACK_PAINT)
+        untouched++;
+    stats->stack_size = stack_words[id] * 4;
+    stats->stack_used = (stack_words[id] - untouched) * 4;
+    return true;
+}
+
+const char *ampi_co_state_name(enum ampi_co_state state)
+{
+    switch (state) {
+    case AMPI_CO_FREE:              return "free";
+    case AMPI_CO_READY:             return "ready";
+    case AMPI_CO_RUNNING:           return "running";
+    case AMPI_CO_WAIT_TICK:         return "tick";
+    case AMPI_CO_WAIT_SEMAPHORE:    return "semaphore";
+    case AMPI_CO_WAIT_MUTEX:        return "mutex";
+    case AMPI_CO_WAIT_RWLOCK:       return "rwlock";
+    case AMPI_CO_WAIT_COMPLETION:   return "completion";
+    }
+    return "?";
+}
@@ -14,18 +14,106 @@ extern "C" {
 // switch happens, with the argument being the ID of the
 // thread being switched to, or 0 if yielding from a thread.
 
-// If yield() is called on the main thread, ampi_co_next()
-// will be called for each active thread instead.
+// Threads only run when they are ready, in the order they became
+// ready. A thread blocks on an object (a semaphore, completion,
+// ...) with
+//     ampi_co_prepare_wait(obj, AMPI_CO_WAIT_...);
+//     if (!condition) ampi_co_wait();
+//     ampi_co_finish_wait();
+// (or just ampi_co_wait_until) and goes back on the ready queue
+// when someone calls ampi_co_wake(obj), which is safe from
+// interrupt handlers. Preparing before checking the condition
+// means a wakeup can't be missed. ampi_co_prepare_wait_deadline()
+// also wakes the thread once jiffies reaches the deadline, which
+// ampi_co_tick() checks.
 
+// ampi_co_yield() from a thread waits for the next tick. If it
+// is called on the main thread, the ready threads run instead.
+
+// Each thread gets its own stack of 'stack_size' bytes from a pool
+// of AMPI_CO_STACK_POOL bytes that is never freed. Stacks are painted
+// when the thread is created, and ampi_co_get_stats() reports how
+// deep each one has been used, to size them by.
+
+// ampi_co_run_ready() runs ready threads until none are left.
+// It is a no-op if threads are being run already, so it can be
+// called from any interrupt that may have woken one.
+
+#include <stdbool.h>
 #include <stdint.h>
 
 #define MAX_CO      8
 
-int8_t ampi_co_create(void (*fn)(void *), void *arg);
+#ifndef AMPI_CO_STACK_POOL
+#define AMPI_CO_STACK_POOL  (96 * 1024)
+#endif
+
+enum ampi_co_state
+{
+    AMPI_CO_FREE,
+    AMPI_CO_READY,
+    AMPI_CO_RUNNING,
+    // Wait reasons
+    AMPI_CO_WAIT_TICK,
+    AMPI_CO_WAIT_SEMAPHORE,
+    AMPI_CO_WAIT_MUTEX,
+    AMPI_CO_WAIT_RWLOCK,
+    AMPI_CO_WAIT_COMPLETION,
+};
+
+struct ampi_co_stats
+{
+    enum ampi_co_state state;
+    const void *wait_obj;       // what it is blocked on, if waiting
+    uint32_t switches;          // times it has been switched to
+    uint32_t run_us;            // total time it has run
+    uint32_t max_run_us;        // longest single run
+    uint32_t stack_size;
+    uint32_t stack_used;        // deepest it has reached, from the paint
+};
+
+// Returns 0 if all threads are taken or the pool can't fit the stack
+int8_t ampi_co_create(void (*fn)(void *), void *arg, uint32_t stack_size);
 void ampi_co_yield();
 void ampi_co_next(int8_t id);
 void ampi_co_callback(void (*cb)(int8_t));
 
+void ampi_co_prepare_wait(const void *obj, enum ampi_co_state reason);
+void ampi_co_prepare_wait_deadline(const void *obj, enum ampi_co_state reason,
+                                   unsigned long deadline);
+void ampi_co_wait();
+void ampi_co_finish_wait();
+void ampi_co_wake(const void *obj);
+void ampi_co_tick();
+void ampi_co_run_ready();
+
+// Returns false if no thread has this ID
+bool ampi_co_get_stats(int8_t id, struct ampi_co_stats *stats);
+const char *ampi_co_state_name(enum ampi_co_state state);
+
+// Blocks the calling thread until 'cond' holds, sleeping on 'obj'
+// in between.
+#define ampi_co_wait_until(obj, reason, cond)       \
+    do {                                            \
+        for (;;) {                                  \
+            ampi_co_prepare_wait((obj), (reason));  \
+            if (cond) break;                        \
+            ampi_co_wait();                         \
+        }                                           \
+        ampi_co_finish_wait();                      \
+    } while (0)
+
+// The same, but also looks again once jiffies reaches 'deadline'.
+#define ampi_co_wait_until_deadline(obj, reason, deadline, cond)        \
+    do {                                                                \
+        for (;;) {                                                      \
+            ampi_co_prepare_wait_deadline((obj), (reason), (deadline)); \
+            if (cond) break;                                            \
+            ampi_co_wait();                                             \
+        }                                                               \
+        ampi_co_finish_wait();                                          \
+    } while (0)
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,6 +1,7 @@
 #include <linux/interrupt.h>
 #include <linux/device.h>
 #include <linux/bug.h>
+#include <linux/coroutine.h>
 #include <ampienv.h>
 
 static void irq_stub (void *param)
@@ -10,6 +11,9 @@ static void irq_stub (void *param)
 	irqreturn_t ret = (*irqaction->handler) (irqaction->irq, irqaction->dev_id);
 
 	BUG_ON (ret != IRQ_HANDLED);
+
+	// run whatever the handler woke up now rather than at the next tick
+	ampi_co_run_ready ();
 }
 
 int __must_check devm_request_irq (struct device *dev, unsigned int irq, irq_handler_t handler,
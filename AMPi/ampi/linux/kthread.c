@@ -6,12 +6,55 @@ struct task_struct *current = 0;
 
 static struct task_struct tasks[MAX_CO];
 
+// Stacks for the threads VCHIQ creates, by name. The slot handler runs
+// the services' callbacks, including the audio chunk callback, so it
+// gets the most. AMPiGetThreadStats() shows how much each one uses.
+static const struct
+{
+	const char *prefix;
+	unsigned size;
+}
+stack_sizes[] =
+{
+	{"VCHIQ-",	32 * 1024},	// slot handler
+	{"VCHIQr-",	12 * 1024},	// recycle
+	{"VCHIQs-",	12 * 1024},	// sync
+	{"VCHIQka-",	12 * 1024},	// keepalive
+};
+
+#ifndef KTHREAD_STACK_SIZE
+#define KTHREAD_STACK_SIZE	(16 * 1024)
+#endif
+
+static unsigned stack_size (const char *name)
+{
+	for (unsigned i = 0; i < sizeof stack_sizes / sizeof stack_sizes[0]; i++)
+	{
+		const char *p = stack_sizes[i].prefix, *q = name;
+		while (*p != '\0' && *p == *q)
+		{
+			p++;
+			q++;
+		}
+		if (*p == '\0')
+		{
+			return stack_sizes[i].size;
+		}
+	}
+
+	return KTHREAD_STACK_SIZE;
+}
+
 struct task_struct *kthread_create (int (*threadfn)(void *data),
 				    void *data,
 				    const char namefmt[], ...)
 {
 	// Such function pointer casts are safe for most platforms including ARM
-	int pid = ampi_co_create ((void (*)(void *))threadfn, data);
+	int pid = ampi_co_create ((void (*)(void *))threadfn, data, stack_size (namefmt));
+	if (pid == 0)
+	{
+		return NULL;
+	}
 
 	struct task_struct *task = &tasks[pid];
 	task->pid = pid;
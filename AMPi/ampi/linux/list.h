@@ -43,6 +43,31 @@ static inline void list_del (struct list_head *entry)
 	prev->next = next;
 }
 
+static inline int list_empty (const struct list_head *head)
+{
+	return head->next == head;
+}
+
+// moves all entries of list to the end of head and empties list
+static inline void list_splice_tail_init (struct list_head *list, struct list_head *head)
+{
+	if (list_empty (list))
+	{
+		return;
+	}
+
+	struct list_head *first = list->next;
+	struct list_head *last = list->prev;
+	struct list_head *prev = head->prev;
+
+	first->prev = prev;
+	prev->next = first;
+	last->next = head;
+	head->prev = last;
+
+	INIT_LIST_HEAD (list);
+}
+
 #define list_entry(ptr, type, member) \
 	container_of(ptr, type, member)
 
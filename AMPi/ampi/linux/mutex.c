@@ -8,10 +8,7 @@ void mutex_lock (struct mutex *lock)
 	BUG_ON (CMultiCoreSupport::ThisCore () != 0);
 #endif
 
-	while (lock->lock != 0)
-	{
-		ampi_co_yield();
-	}
+	ampi_co_wait_until (lock, AMPI_CO_WAIT_MUTEX, lock->lock == 0);
 
 	lock->lock = 1;
 }
@@ -23,4 +20,6 @@ void mutex_unlock (struct mutex *lock)
 #endif
 
 	lock->lock = 0;
+
+	ampi_co_wake (lock);
 }
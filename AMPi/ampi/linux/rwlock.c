@@ -12,10 +12,7 @@ void read_lock_bh (rwlock_t *lock)
 
 	lock->lock++;
 
-	while (lock->lock >= WRITE_LOCK)
-	{
-		ampi_co_yield();
-	}
+	ampi_co_wait_until (lock, AMPI_CO_WAIT_RWLOCK, lock->lock < WRITE_LOCK);
 }
 
 void read_unlock_bh (rwlock_t *lock)
@@ -25,6 +22,8 @@ void read_unlock_bh (rwlock_t *lock)
 #endif
 
 	lock->lock--;
+
+	ampi_co_wake (lock);
 }
 
 void write_lock_bh (rwlock_t *lock)
@@ -35,10 +34,7 @@ void write_lock_bh (rwlock_t *lock)
 
 	lock->lock |= WRITE_LOCK;
 
-	while ((lock->lock & ~WRITE_LOCK) != 0)
-	{
-		ampi_co_yield();
-	}
+	ampi_co_wait_until (lock, AMPI_CO_WAIT_RWLOCK, (lock->lock & ~WRITE_LOCK) == 0);
 }
 
 void write_unlock_bh (rwlock_t *lock)
@@ -48,4 +44,6 @@ void write_unlock_bh (rwlock_t *lock)
 #endif
 
 	lock->lock &= ~WRITE_LOCK;
+
+	ampi_co_wake (lock);
 }
@@ -1,6 +1,7 @@
 #include <linux/semaphore.h>
 #include <linux/bug.h>
 #include <linux/coroutine.h>
+#include <linux/synchronize.h>
 
 void down (struct semaphore *sem)
 {
@@ -8,12 +9,12 @@ void down (struct semaphore *sem)
 	BUG_ON (CMultiCoreSupport::ThisCore () != 0);
 #endif
 
-	while (sem->count == 0)
-	{
-		ampi_co_yield();
-	}
+	ampi_co_wait_until (sem, AMPI_CO_WAIT_SEMAPHORE, sem->count != 0);
 
+	// up() may be called from an interrupt handler
+	linuxemu_EnterCritical ();
 	sem->count--;
+	linuxemu_LeaveCritical ();
 }
 
 void up (struct semaphore *sem)
@@ -22,7 +23,13 @@ void up (struct semaphore *sem)
 	BUG_ON (CMultiCoreSupport::ThisCore () != 0);
 #endif
 
+	// Also called from thread context with interrupts enabled, where an
+	// interrupt calling up() between the load and the store would lose a count
+	linuxemu_EnterCritical ();
 	sem->count++;
+	linuxemu_LeaveCritical ();
+
+	ampi_co_wake (sem);
 }
 
 int down_trylock (struct semaphore *sem)
@@ -36,7 +43,9 @@ int down_trylock (struct semaphore *sem)
 		return 1;
 	}
 
+	linuxemu_EnterCritical ();
 	sem->count--;
+	linuxemu_LeaveCritical ();
 
 	return 0;
 }
@@ -3,14 +3,25 @@
 #include <linux/spinlock.h>
 #include <ampienv.h>
 
-// include/circle/timer.h
-#define HZ		100			// ticks per second
+#define HZ		AMPI_TICK_HZ		// ticks per second
 
-#define MSEC2HZ(msec)	((msec) * HZ / 1000)
+// rounded up, so a timeout never ends early
+#define MSEC2HZ(msec)	(((msec) * HZ + 999) / 1000)
 
 unsigned long volatile jiffies = 0;
 
-static struct list_head timer_list;
+// Timers are kept in a hierarchical wheel: level 0 has a slot for each of
+// the next 64 ticks, and every further level has slots 64 times as coarse.
+// Adding or deleting a timer is a list operation on one slot. When level 0
+// wraps around, the due slot of the level above is cascaded, i.e. its
+// timers are sorted into the finer levels again.
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4			// 2^24 ticks, 4.6 hours at 1 kHz
+
+static struct list_head wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static unsigned long wheel_jiffies;		// next tick whose slot has not run
 static struct spinlock timer_lock;
 
 unsigned long msecs_to_jiffies (const unsigned int msecs)
@@ -27,23 +38,40 @@ void init_timer (struct timer_list *timer)
 	timer->data = 0;
 }
 
-void add_timer (struct timer_list *timer)
+// call with timer_lock held
+static void enqueue_timer (struct timer_list *timer)
 {
-	spin_lock (&timer_lock);
-
 	unsigned long expires = timer->expires;
+	unsigned long delta = expires - wheel_jiffies;
 
-	struct list_head *pos;
-	list_for_each (pos, &timer_list)
+	if ((long) delta < 0)
 	{
-		struct timer_list *t = list_entry (pos, struct timer_list, entry);
-		if ((long) (t->expires-expires) < 0)
-		{
-			break;
-		}
+		// already due, runs on the next tick
+		expires = wheel_jiffies;
+		delta = 0;
+	}
+	else if (delta >= 1UL << (WHEEL_LEVELS * WHEEL_BITS))
+	{
+		// gets cascaded back in as often as needed
+		delta = (1UL << (WHEEL_LEVELS * WHEEL_BITS)) - 1;
+		expires = wheel_jiffies + delta;
+	}
+
+	unsigned level = 0;
+	while (delta >> ((level + 1) * WHEEL_BITS) != 0)
+	{
+		level++;
 	}
 
-	list_add (&timer->entry, pos);
+	unsigned index = (expires >> (level * WHEEL_BITS)) & WHEEL_MASK;
+	list_add_tail (&timer->entry, &wheel[level][index]);
+}
+
+void add_timer (struct timer_list *timer)
+{
+	spin_lock (&timer_lock);
+
+	enqueue_timer (timer);
 
 	spin_unlock (&timer_lock);
 }
@@ -71,46 +99,77 @@ int del_timer (struct timer_list *timer)
 	return ret;
 }
 
-static void periodic_handler (void)
+// call with timer_lock held, returns the slot cascaded
+static unsigned cascade (unsigned level)
 {
-	spin_lock (&timer_lock);
+	unsigned index = (wheel_jiffies >> (level * WHEEL_BITS)) & WHEEL_MASK;
 
-	++jiffies;
-	unsigned long now = jiffies;
+	struct list_head slot;
+	INIT_LIST_HEAD (&slot);
+	list_splice_tail_init (&wheel[level][index], &slot);
 
-	int cont;
-	do
+	while (!list_empty (&slot))
 	{
-		cont = 0;
-
-		struct list_head *pos = timer_list.next;
-		if (pos != &timer_list)
-		{
-			struct timer_list *t = list_entry (pos, struct timer_list, entry);
-			if ((long) (t->expires-now) <= 0)
-			{
-				list_del (&t->entry);
+		struct timer_list *t = list_entry (slot.next, struct timer_list, entry);
+		list_del (&t->entry);
+		enqueue_timer (t);
+	}
 
-				spin_unlock (&timer_lock);
+	return index;
+}
 
-				INIT_LIST_HEAD (&t->entry);
+static void periodic_handler (void)
+{
+	struct list_head expired;
+	INIT_LIST_HEAD (&expired);
 
-				(*t->function) (t->data);
+	spin_lock (&timer_lock);
 
-				cont = 1;
+	++jiffies;
 
-				spin_lock (&timer_lock);
+	// collect everything due in one go
+	while ((long) (jiffies-wheel_jiffies) >= 0)
+	{
+		unsigned index = wheel_jiffies & WHEEL_MASK;
+		if (index == 0)
+		{
+			// when a level wraps around, the one above is due too
+			unsigned level = 1;
+			while (level < WHEEL_LEVELS && cascade (level) == 0)
+			{
+				level++;
 			}
 		}
+
+		list_splice_tail_init (&wheel[0][index], &expired);
+		wheel_jiffies++;
 	}
-	while (cont);
 
 	spin_unlock (&timer_lock);
+
+	// We are called from the timer interrupt, so nothing but the
+	// functions below can touch the list until it is empty. They
+	// may add timers, or delete ones that are still on it.
+	while (!list_empty (&expired))
+	{
+		struct timer_list *t = list_entry (expired.next, struct timer_list, entry);
+		list_del (&t->entry);
+		INIT_LIST_HEAD (&t->entry);
+
+		(*t->function) (t->data);
+	}
 }
 
 int linuxemu_init_timer (void)
 {
-	INIT_LIST_HEAD (&timer_list);
+	for (unsigned level = 0; level < WHEEL_LEVELS; level++)
+	{
+		for (unsigned index = 0; index < WHEEL_SIZE; index++)
+		{
+			INIT_LIST_HEAD (&wheel[level][index]);
+		}
+	}
+	wheel_jiffies = jiffies;
 	spin_lock_init (&timer_lock);
 
 	RegisterPeriodicHandler (periodic_handler);
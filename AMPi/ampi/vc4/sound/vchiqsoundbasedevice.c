@@ -22,13 +22,45 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <vc4/sound/vchiqsoundbasedevice.h>
+#include <vc4/vchiq/vchiq_if.h>
 #include <linux/assert.h>
 #include <linux/coroutine.h>
+#include <linux/barrier.h>
+#include <string.h>
+#include <ampienv.h>
 
 #define LOG(...)
 
 #define VOLUME_TO_CHIP(volume)        ((unsigned) -(((volume) << 8) / 100))
 
+#define MAX_PACKET          4000
+#define MAX_BATCH           8       // messages queued together at most
+
+// The statistics are written under a sequence count, see GetStats
+static void CVCHIQSoundBaseDevice_BeginStats (CVCHIQSoundBaseDevice *_this)
+{
+    _this->m_nStatsSequence++;
+    smp_wmb ();
+
+    if (_this->m_bResetStats)
+    {
+        _this->m_bResetStats = FALSE;
+        _this->m_nMinHeadroom = (unsigned) -1;
+        _this->m_nUnderruns = 0;
+        _this->m_nLateCompletions = 0;
+        _this->m_nCallbacks = 0;
+        _this->m_nCallbackMin = (unsigned) -1;
+        _this->m_nCallbackMax = 0;
+        _this->m_nCallbackTotal = 0;
+    }
+}
+
+static void CVCHIQSoundBaseDevice_EndStats (CVCHIQSoundBaseDevice *_this)
+{
+    smp_wmb ();
+    _this->m_nStatsSequence++;
+}
+
 // protected and private functions
 int CVCHIQSoundBaseDevice_QueueMessage (CVCHIQSoundBaseDevice *_this, VC_AUDIO_MSG_T *pMessage)
 {
@@ -63,7 +95,17 @@ int CVCHIQSoundBaseDevice_WriteChunk (CVCHIQSoundBaseDevice *_this)
 {
     if (_this->ChunkCallback == 0) return 0;
     s16 *Buffer = 0;
+    unsigned nCallbackMicros = GetMicroseconds ();
     unsigned nWords = (*_this->ChunkCallback) (&Buffer, _this->m_nChunkSize);
+    nCallbackMicros = GetMicroseconds () - nCallbackMicros;
+
+    CVCHIQSoundBaseDevice_BeginStats (_this);
+    _this->m_nCallbacks++;
+    _this->m_nCallbackTotal += nCallbackMicros;
+    if (nCallbackMicros < _this->m_nCallbackMin) _this->m_nCallbackMin = nCallbackMicros;
+    if (nCallbackMicros > _this->m_nCallbackMax) _this->m_nCallbackMax = nCallbackMicros;
+    CVCHIQSoundBaseDevice_EndStats (_this);
+
     if (nWords == 0 || Buffer == 0)
     {
         _this->m_State = VCHIQSoundIdle;
@@ -72,43 +114,113 @@ int CVCHIQSoundBaseDevice_WriteChunk (CVCHIQSoundBaseDevice *_this)
     }
 
     unsigned nBytes = nWords * sizeof (s16);
+    enum TVCHIQSoundSubmitPath Path =   _this->m_bBulk
+                      ? VCHIQSoundSubmitBulk
+                      : (  _this->m_bBatch
+                         ? VCHIQSoundSubmitBatched
+                         : VCHIQSoundSubmitMessages);
+    unsigned nStartMicros = GetMicroseconds ();
+    unsigned nStartDoorbells = vchiq_get_doorbell_count ();
 
     VC_AUDIO_MSG_T Msg;
 
     Msg.type = VC_AUDIO_MSG_TYPE_WRITE;
     Msg.u.write.count = nBytes;
-    Msg.u.write.max_packet = 4000;
+    // a max_packet of 0 tells the VideoCore to expect the data as a bulk transfer
+    Msg.u.write.max_packet = Path == VCHIQSoundSubmitBulk ? 0 : MAX_PACKET;
     Msg.u.write.cookie1 = VC_AUDIO_WRITE_COOKIE1;
     Msg.u.write.cookie2 = VC_AUDIO_WRITE_COOKIE2;
     Msg.u.write.silence = 0;
 
-    int nResult = vchi_msg_queue (_this->m_hService, &Msg, sizeof Msg, VCHI_FLAGS_BLOCK_UNTIL_QUEUED, 0);
-    if (nResult != 0)
-    {
-        return nResult;
-    }
-
-    _this->m_nWritePos += nBytes;
+    // the write header and the data packets, as (up to MAX_BATCH) messages
+    VCHI_MSG_VECTOR_T Messages[MAX_BATCH];
+    unsigned nMessages = 0, nSent = 0;
+    Messages[nMessages].vec_base = &Msg;
+    Messages[nMessages++].vec_len = sizeof Msg;
 
+    int nResult = 0;
     u8 *pBuffer8 = (u8 *) Buffer;
-    while (nBytes > 0)
+    unsigned nBytesLeft = Path == VCHIQSoundSubmitBulk ? 0 : nBytes;
+    do
     {
-        unsigned nBytesToQueue =   nBytes <= Msg.u.write.max_packet
-                     ? nBytes
-                     : Msg.u.write.max_packet;
+        while (nBytesLeft > 0 && nMessages < MAX_BATCH)
+        {
+            unsigned nBytesToQueue = nBytesLeft <= MAX_PACKET ? nBytesLeft : MAX_PACKET;
 
-        nResult = vchi_msg_queue (_this->m_hService, pBuffer8, nBytesToQueue,
-                      VCHI_FLAGS_BLOCK_UNTIL_QUEUED, 0);
+            Messages[nMessages].vec_base = pBuffer8;
+            Messages[nMessages++].vec_len = nBytesToQueue;
+
+            pBuffer8 += nBytesToQueue;
+            nBytesLeft -= nBytesToQueue;
+        }
+
+        if (Path == VCHIQSoundSubmitBatched)
+        {
+            nResult = vchi_msg_queue_batch (_this->m_hService, Messages, nMessages,
+                            VCHI_FLAGS_BLOCK_UNTIL_QUEUED, 0);
+        }
+        else
+        {
+            for (unsigned i = 0; i < nMessages && nResult == 0; i++)
+            {
+                nResult = vchi_msg_queue (_this->m_hService, Messages[i].vec_base,
+                              Messages[i].vec_len, VCHI_FLAGS_BLOCK_UNTIL_QUEUED, 0);
+            }
+        }
         if (nResult != 0)
         {
             return nResult;
         }
 
-        pBuffer8 += nBytesToQueue;
-        nBytes -= nBytesToQueue;
+        if (nSent == 0)
+        {
+            // the header is out
+            _this->m_nWritePos += nBytes;
+        }
+        nSent += nMessages;
+        nMessages = 0;
     }
+    while (nBytesLeft > 0);
 
-    return 0;
+    if (Path == VCHIQSoundSubmitBulk)
+    {
+        // The VideoCore reads the data before it plays it, and the callback
+        // leaves the buffer alone until then, so it needn't wait here
+        nResult = vchi_bulk_queue_transmit (_this->m_hService, Buffer, nBytes,
+                            VCHI_FLAGS_BLOCK_UNTIL_QUEUED, 0);
+        nSent++;
+    }
+
+    if (nResult == 0)
+    {
+        TVCHIQSoundSubmitStats *pStats = &_this->m_SubmitStats[Path];
+        pStats->nChunks++;
+        pStats->nMicros += GetMicroseconds () - nStartMicros;
+        pStats->nMessages += nSent;
+        pStats->nDoorbells += vchiq_get_doorbell_count () - nStartDoorbells;
+    }
+
+    return nResult;
+}
+
+static void CVCHIQSoundBaseDevice_RecordCompletion (CVCHIQSoundBaseDevice *_this, unsigned nBytes)
+{
+    unsigned nNow = GetMicroseconds ();
+    unsigned nHeadroom = _this->m_nWritePos - _this->m_nCompletePos;
+
+    CVCHIQSoundBaseDevice_BeginStats (_this);
+    if (nHeadroom < _this->m_nMinHeadroom) _this->m_nMinHeadroom = nHeadroom;
+    if (nHeadroom == 0) _this->m_nUnderruns++;
+    if (_this->m_bCompleteSeen)
+    {
+        // 4 bytes per stereo frame
+        unsigned nExpected = nBytes / 4 * 1000000 / _this->m_nSampleRate;
+        if (nNow - _this->m_nLastCompleteMicros > nExpected + nExpected / 2) _this->m_nLateCompletions++;
+    }
+    CVCHIQSoundBaseDevice_EndStats (_this);
+
+    _this->m_nLastCompleteMicros = nNow;
+    _this->m_bCompleteSeen = TRUE;
 }
 
 void CVCHIQSoundBaseDevice_Callback (CVCHIQSoundBaseDevice *_this, const VCHI_CALLBACK_REASON_T Reason, void *hMessage)
@@ -160,6 +272,8 @@ void CVCHIQSoundBaseDevice_Callback (CVCHIQSoundBaseDevice *_this, const VCHI_CA
 
         _this->m_nCompletePos += Msg.u.complete.count & 0x3FFFFFFF;
 
+        CVCHIQSoundBaseDevice_RecordCompletion (_this, Msg.u.complete.count & 0x3FFFFFFF);
+
         // if there is no more than one chunk left queued
         if (_this->m_nWritePos-_this->m_nCompletePos <= _this->m_nChunkSize*sizeof (s16))
         {
@@ -201,7 +315,7 @@ void CVCHIQSoundBaseDevice_Ctor (CVCHIQSoundBaseDevice *_this, CVCHIQDevice *pVC
                           unsigned nChunkSize,
                           enum TVCHIQSoundDestination Destination)
 {
-    //assert (44100 <= nSampleRate && nSampleRate <= 48000);
+    assert (44100 <= nSampleRate && nSampleRate <= 48000);
     assert (Destination < VCHIQSoundDestinationUnknown);
 
     _this->ChunkCallback = 0;
@@ -211,6 +325,12 @@ void CVCHIQSoundBaseDevice_Ctor (CVCHIQSoundBaseDevice *_this, CVCHIQDevice *pVC
     _this->m_State = VCHIQSoundCreated;
     _this->m_VCHIInstance = 0;
     _this->m_hService = 0;
+    _this->m_bBulk = FALSE;
+    _this->m_bBatch = TRUE;
+    memset (_this->m_SubmitStats, 0, sizeof _this->m_SubmitStats);
+    _this->m_nStatsSequence = 0;
+    _this->m_bResetStats = TRUE;
+    _this->m_bCompleteSeen = FALSE;
 
     //CDeviceNameService::Get ()->AddDevice ("sndvchiq", this, FALSE);
 }
@@ -351,7 +471,7 @@ boolean CVCHIQSoundBaseDevice_Start (CVCHIQSoundBaseDevice *_this)
         return FALSE;
     }
 
-    // we need peer version 2, because we do not support bulk transfers
+    // we need peer version 2 for the message path, which is the default
     if (usPeerVersion < 2)
     {
         vchi_service_release (_this->m_hService);
@@ -366,6 +486,9 @@ boolean CVCHIQSoundBaseDevice_Start (CVCHIQSoundBaseDevice *_this)
 
     _this->m_nWritePos = 0;
     _this->m_nCompletePos = 0;
+    // the first completion after a start is delayed by the start itself
+    _this->m_bCompleteSeen = FALSE;
+    _this->m_bResetStats = TRUE;
 
     nResult = CVCHIQSoundBaseDevice_WriteChunk (_this);
     if (nResult == 0)
@@ -433,6 +556,69 @@ boolean CVCHIQSoundBaseDevice_IsActive (CVCHIQSoundBaseDevice *_this)
     return _this->m_State >= VCHIQSoundRunning;
 }
 
+void CVCHIQSoundBaseDevice_SetChunkSize (CVCHIQSoundBaseDevice *_this, unsigned nChunkSize)
+{
+    assert (nChunkSize > 0);
+
+    _this->m_nChunkSize = nChunkSize;
+}
+
+unsigned CVCHIQSoundBaseDevice_GetQueuedBytes (CVCHIQSoundBaseDevice *_this)
+{
+    return _this->m_nWritePos - _this->m_nCompletePos;
+}
+
+void CVCHIQSoundBaseDevice_GetStats (CVCHIQSoundBaseDevice *_this, TVCHIQSoundStats *pStats)
+{
+    // start over if the callback updated the statistics while we copied them
+    unsigned nSequence;
+    do
+    {
+        while ((nSequence = _this->m_nStatsSequence) & 1)
+        {
+        }
+        smp_rmb ();
+
+        pStats->nMinHeadroomBytes = _this->m_nMinHeadroom;
+        pStats->nUnderruns = _this->m_nUnderruns;
+        pStats->nLateCompletions = _this->m_nLateCompletions;
+        pStats->nCallbacks = _this->m_nCallbacks;
+        pStats->nCallbackMinMicros = _this->m_nCallbackMin;
+        pStats->nCallbackMaxMicros = _this->m_nCallbackMax;
+        pStats->nCallbackAvgMicros = _this->m_nCallbacks != 0 ? _this->m_nCallbackTotal / _this->m_nCallbacks : 0;
+
+        smp_rmb ();
+    }
+    while (_this->m_nStatsSequence != nSequence);
+
+    // nothing recorded yet since a reset
+    if (_this->m_bResetStats)
+    {
+        memset (pStats, 0, sizeof *pStats);
+    }
+    if (pStats->nCallbacks == 0)
+    {
+        pStats->nCallbackMinMicros = 0;
+    }
+    if (pStats->nMinHeadroomBytes == (unsigned) -1)
+    {
+        pStats->nMinHeadroomBytes = 0;
+    }
+    pStats->nQueuedBytes = CVCHIQSoundBaseDevice_GetQueuedBytes (_this);
+}
+
+void CVCHIQSoundBaseDevice_ResetStats (CVCHIQSoundBaseDevice *_this)
+{
+    _this->m_bResetStats = TRUE;
+}
+
+void CVCHIQSoundBaseDevice_GetSubmitStats (CVCHIQSoundBaseDevice *_this,
+    enum TVCHIQSoundSubmitPath Path, TVCHIQSoundSubmitStats *pStats)
+{
+    assert (Path < VCHIQSoundSubmitPaths);
+    *pStats = _this->m_SubmitStats[Path];
+}
+
 void CVCHIQSoundBaseDevice_SetControl (CVCHIQSoundBaseDevice *_this, int nVolume, enum TVCHIQSoundDestination Destination)
 {
     if (!(VCHIQ_SOUND_VOLUME_MIN <= nVolume && nVolume <= VCHIQ_SOUND_VOLUME_MAX))
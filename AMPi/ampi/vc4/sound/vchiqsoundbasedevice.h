@@ -41,6 +41,23 @@ enum TVCHIQSoundDestination
     VCHIQSoundDestinationUnknown
 };
 
+// How a chunk is handed to VCHIQ
+enum TVCHIQSoundSubmitPath
+{
+    VCHIQSoundSubmitMessages,       // write header and data packets queued one by one
+    VCHIQSoundSubmitBatched,        // the same messages queued together
+    VCHIQSoundSubmitBulk,           // write header, then a bulk transfer
+    VCHIQSoundSubmitPaths
+};
+
+typedef struct TVCHIQSoundSubmitStats
+{
+    unsigned nChunks;
+    unsigned nMicros;               // after ChunkCallback returned
+    unsigned nMessages;             // VCHIQ messages queued, counting a bulk transfer as one
+    unsigned nDoorbells;            // times the VideoCore's doorbell was rung meanwhile
+} TVCHIQSoundSubmitStats;
+
 enum TVCHIQSoundState
 {
     VCHIQSoundCreated,
@@ -54,12 +71,24 @@ enum TVCHIQSoundState
 
 typedef unsigned (*chunk_cb_t) (int16_t **pBuffer, unsigned nChunkSize);
 
+typedef struct TVCHIQSoundStats
+{
+    unsigned nQueuedBytes;          // sent, but not played yet
+    unsigned nMinHeadroomBytes;     // least left queued when a chunk completed
+    unsigned nUnderruns;            // completions that left nothing queued
+    unsigned nLateCompletions;      // completions that came over 50% later than the audio they reported lasts
+    unsigned nCallbacks;
+    unsigned nCallbackMinMicros;    // time spent in ChunkCallback
+    unsigned nCallbackAvgMicros;
+    unsigned nCallbackMaxMicros;
+} TVCHIQSoundStats;
+
 typedef struct CVCHIQSoundBaseDevice_s
 {
     chunk_cb_t ChunkCallback;
 
     unsigned m_nSampleRate;
-    unsigned m_nChunkSize;
+    volatile unsigned m_nChunkSize;
     enum TVCHIQSoundDestination m_Destination;
 
     volatile enum TVCHIQSoundState m_State;
@@ -70,8 +99,29 @@ typedef struct CVCHIQSoundBaseDevice_s
     volatile bool m_Event;
     int m_nResult;
 
-    unsigned m_nWritePos;
-    unsigned m_nCompletePos;
+    volatile unsigned m_nWritePos;
+    volatile unsigned m_nCompletePos;
+
+    // send chunks as bulk transfers from the callback's buffer instead of
+    // copying them into messages
+    volatile boolean m_bBulk;
+    // queue a chunk's messages together rather than one at a time
+    volatile boolean m_bBatch;
+    TVCHIQSoundSubmitStats m_SubmitStats[VCHIQSoundSubmitPaths];
+
+    // statistics, only written from the VCHIQ callback; m_nStatsSequence is
+    // odd while they are being updated, so readers can retry instead of locking
+    volatile unsigned m_nStatsSequence;
+    volatile boolean m_bResetStats;
+    unsigned m_nMinHeadroom;
+    unsigned m_nUnderruns;
+    unsigned m_nLateCompletions;
+    unsigned m_nCallbacks;
+    unsigned m_nCallbackMin;
+    unsigned m_nCallbackMax;
+    unsigned m_nCallbackTotal;
+    unsigned m_nLastCompleteMicros;
+    boolean m_bCompleteSeen;
 } CVCHIQSoundBaseDevice;
 
 /// \param pVCHIQDevice    pointer to the VCHIQ interface device
@@ -98,6 +148,24 @@ boolean CVCHIQSoundBaseDevice_Cancel (CVCHIQSoundBaseDevice *_this);
 /// \return Is the sound data transmission running?
 boolean CVCHIQSoundBaseDevice_IsActive (CVCHIQSoundBaseDevice *_this);
 
+/// \param nChunkSize    number of samples to transfer at once from the next chunk on
+/// \note This method can be called, while the sound data transmission is running.
+void CVCHIQSoundBaseDevice_SetChunkSize (CVCHIQSoundBaseDevice *_this, unsigned nChunkSize);
+
+/// \return Number of bytes sent, which have not been played yet
+unsigned CVCHIQSoundBaseDevice_GetQueuedBytes (CVCHIQSoundBaseDevice *_this);
+
+/// \param pStats    where to copy the statistics; can be called while sound is running
+void CVCHIQSoundBaseDevice_GetStats (CVCHIQSoundBaseDevice *_this, TVCHIQSoundStats *pStats);
+
+/// \brief Restarts the statistics from the next chunk on
+void CVCHIQSoundBaseDevice_ResetStats (CVCHIQSoundBaseDevice *_this);
+
+/// \param Path    the way of sending chunks to report on
+/// \param pStats    where to copy the totals for chunks sent that way so far
+void CVCHIQSoundBaseDevice_GetSubmitStats (CVCHIQSoundBaseDevice *_this,
+    enum TVCHIQSoundSubmitPath Path, TVCHIQSoundSubmitStats *pStats);
+
 /// \param nVolume    Output volume to be set (-10000..400)
 /// \param Destination    the target device, the sound data is sent to\n
 ///            (not modified, if equal to VCHIQSoundDestinationUnknown)
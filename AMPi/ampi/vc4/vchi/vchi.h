@@ -254,6 +254,14 @@ int32_t vchi_msg_queuev( VCHI_SERVICE_HANDLE_T handle,
                          VCHI_FLAGS_T flags,
                          void *msg_handle );
 
+// send several messages, one per vector element, reserving slot space for
+// them together and signalling the other side once
+int32_t vchi_msg_queue_batch( VCHI_SERVICE_HANDLE_T handle,
+                              VCHI_MSG_VECTOR_T *messages,
+                              uint32_t count,
+                              VCHI_FLAGS_T flags,
+                              void *msg_handle );
+
 // Routine to receive a msg from a service
 // Dequeue is equivalent to hold, copy into client buffer, release
 extern int32_t vchi_msg_dequeue( VCHI_SERVICE_HANDLE_T handle,
@@ -238,6 +238,14 @@ vchiq_platform_get_arm_state(VCHIQ_STATE_T *state)
    return &((VCHIQ_2835_ARM_STATE_T*)state->platform_state)->arm_state;
 }
 
+static unsigned int g_doorbells;
+
+unsigned int
+vchiq_get_doorbell_count(void)
+{
+	return g_doorbells;
+}
+
 void
 remote_event_signal(REMOTE_EVENT_T *event)
 {
@@ -247,8 +255,10 @@ remote_event_signal(REMOTE_EVENT_T *event)
 
 	dsb();         /* data barrier operation */
 
-	if (event->armed)
+	if (event->armed) {
+		g_doorbells++;
 		writel(0, g_regs + BELL2); /* trigger vc interrupt */
+	}
 }
 
 int
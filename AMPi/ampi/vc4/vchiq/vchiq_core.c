@@ -754,6 +754,130 @@ process_free_queue(VCHIQ_STATE_T *state)
 	}
 }
 
+/* Called by queue_message and queue_message_batch with slot_mutex held, for
+** 'count' data messages taking 'stride' bytes in all. Waits until the service
+** and the data slots have quota for them. Returns VCHIQ_SUCCESS with the mutex
+** still held, or another status with it released. */
+static VCHIQ_STATUS_T
+wait_for_data_quota(VCHIQ_STATE_T *state, VCHIQ_SERVICE_T *service,
+	int count, unsigned int stride, int size)
+{
+	VCHIQ_SERVICE_QUOTA_T *service_quota =
+		&state->service_quotas[service->localport];
+	int type = VCHIQ_MSG_DATA;
+	int tx_end_index;
+
+	if (service->closing) {
+		/* The service has been closed */
+		mutex_unlock(&state->slot_mutex);
+		return VCHIQ_ERROR;
+	}
+
+	spin_lock(&quota_spinlock);
+
+	/* Ensure this service doesn't use more than its quota of
+	** messages or slots */
+	tx_end_index = SLOT_QUEUE_INDEX_FROM_POS(
+		state->local_tx_pos + stride - 1);
+
+	/* Ensure data messages don't use more than their quota of
+	** slots */
+	while ((tx_end_index != state->previous_data_index) &&
+		(state->data_use_count == state->data_quota)) {
+		VCHIQ_STATS_INC(state, data_stalls);
+		spin_unlock(&quota_spinlock);
+		mutex_unlock(&state->slot_mutex);
+
+		if (down_interruptible(&state->data_quota_event)
+			!= 0)
+			return VCHIQ_RETRY;
+
+		mutex_lock(&state->slot_mutex);
+		spin_lock(&quota_spinlock);
+		tx_end_index = SLOT_QUEUE_INDEX_FROM_POS(
+			state->local_tx_pos + stride - 1);
+		if ((tx_end_index == state->previous_data_index) ||
+			(state->data_use_count < state->data_quota)) {
+			/* Pass the signal on to other waiters */
+			up(&state->data_quota_event);
+			break;
+		}
+	}
+
+	while ((service_quota->message_use_count + count >
+			service_quota->message_quota) ||
+		((tx_end_index != service_quota->previous_tx_index) &&
+		(service_quota->slot_use_count ==
+			service_quota->slot_quota))) {
+		spin_unlock(&quota_spinlock);
+		vchiq_log_trace(vchiq_core_log_level,
+			"%d: qm:%d %s,%x - quota stall "
+			"(msg %d, slot %d)",
+			state->id, service->localport,
+			msg_type_str(type), size,
+			service_quota->message_use_count,
+			service_quota->slot_use_count);
+		VCHIQ_SERVICE_STATS_INC(service, quota_stalls);
+		mutex_unlock(&state->slot_mutex);
+		if (down_interruptible(&service_quota->quota_event)
+			!= 0)
+			return VCHIQ_RETRY;
+		if (service->closing)
+			return VCHIQ_ERROR;
+		if (mutex_lock_interruptible(&state->slot_mutex) != 0)
+			return VCHIQ_RETRY;
+		if (service->srvstate != VCHIQ_SRVSTATE_OPEN) {
+			/* The service has been closed */
+			mutex_unlock(&state->slot_mutex);
+			return VCHIQ_ERROR;
+		}
+		spin_lock(&quota_spinlock);
+		tx_end_index = SLOT_QUEUE_INDEX_FROM_POS(
+			state->local_tx_pos + stride - 1);
+	}
+
+	spin_unlock(&quota_spinlock);
+
+	return VCHIQ_SUCCESS;
+}
+
+/* Called with slot_mutex held once 'count' data messages have been written
+** to the slots. Returns the service's new slot use count if they took it
+** into another slot, otherwise 0. */
+static int
+charge_data_quota(VCHIQ_STATE_T *state, VCHIQ_SERVICE_QUOTA_T *service_quota,
+	int count)
+{
+	int tx_end_index;
+	int slot_use_count;
+
+	spin_lock(&quota_spinlock);
+	service_quota->message_use_count += count;
+
+	tx_end_index =
+		SLOT_QUEUE_INDEX_FROM_POS(state->local_tx_pos - 1);
+
+	/* If this transmission can't fit in the last slot used by any
+	** service, the data_use_count must be increased. */
+	if (tx_end_index != state->previous_data_index) {
+		state->previous_data_index = tx_end_index;
+		state->data_use_count++;
+	}
+
+	/* If this isn't the same slot last used by this service,
+	** the service's slot_use_count must be increased. */
+	if (tx_end_index != service_quota->previous_tx_index) {
+		service_quota->previous_tx_index = tx_end_index;
+		slot_use_count = ++service_quota->slot_use_count;
+	} else {
+		slot_use_count = 0;
+	}
+
+	spin_unlock(&quota_spinlock);
+
+	return slot_use_count;
+}
+
 /* Called by the slot handler and application threads */
 static VCHIQ_STATUS_T
 queue_message(VCHIQ_STATE_T *state, VCHIQ_SERVICE_T *service,
@@ -778,84 +902,17 @@ queue_message(VCHIQ_STATE_T *state, VCHIQ_SERVICE_T *service,
 		return VCHIQ_RETRY;
 
 	if (type == VCHIQ_MSG_DATA) {
-		int tx_end_index;
+		VCHIQ_STATUS_T status;
 
 		BUG_ON(!service);
 		BUG_ON((flags & (QMFLAGS_NO_MUTEX_LOCK |
 				 QMFLAGS_NO_MUTEX_UNLOCK)) != 0);
 
-		if (service->closing) {
-			/* The service has been closed */
-			mutex_unlock(&state->slot_mutex);
-			return VCHIQ_ERROR;
-		}
-
 		service_quota = &state->service_quotas[service->localport];
 
-		spin_lock(&quota_spinlock);
-
-		/* Ensure this service doesn't use more than its quota of
-		** messages or slots */
-		tx_end_index = SLOT_QUEUE_INDEX_FROM_POS(
-			state->local_tx_pos + stride - 1);
-
-		/* Ensure data messages don't use more than their quota of
-		** slots */
-		while ((tx_end_index != state->previous_data_index) &&
-			(state->data_use_count == state->data_quota)) {
-			VCHIQ_STATS_INC(state, data_stalls);
-			spin_unlock(&quota_spinlock);
-			mutex_unlock(&state->slot_mutex);
-
-			if (down_interruptible(&state->data_quota_event)
-				!= 0)
-				return VCHIQ_RETRY;
-
-			mutex_lock(&state->slot_mutex);
-			spin_lock(&quota_spinlock);
-			tx_end_index = SLOT_QUEUE_INDEX_FROM_POS(
-				state->local_tx_pos + stride - 1);
-			if ((tx_end_index == state->previous_data_index) ||
-				(state->data_use_count < state->data_quota)) {
-				/* Pass the signal on to other waiters */
-				up(&state->data_quota_event);
-				break;
-			}
-		}
-
-		while ((service_quota->message_use_count ==
-				service_quota->message_quota) ||
-			((tx_end_index != service_quota->previous_tx_index) &&
-			(service_quota->slot_use_count ==
-				service_quota->slot_quota))) {
-			spin_unlock(&quota_spinlock);
-			vchiq_log_trace(vchiq_core_log_level,
-				"%d: qm:%d %s,%x - quota stall "
-				"(msg %d, slot %d)",
-				state->id, service->localport,
-				msg_type_str(type), size,
-				service_quota->message_use_count,
-				service_quota->slot_use_count);
-			VCHIQ_SERVICE_STATS_INC(service, quota_stalls);
-			mutex_unlock(&state->slot_mutex);
-			if (down_interruptible(&service_quota->quota_event)
-				!= 0)
-				return VCHIQ_RETRY;
-			if (service->closing)
-				return VCHIQ_ERROR;
-			if (mutex_lock_interruptible(&state->slot_mutex) != 0)
-				return VCHIQ_RETRY;
-			if (service->srvstate != VCHIQ_SRVSTATE_OPEN) {
-				/* The service has been closed */
-				mutex_unlock(&state->slot_mutex);
-				return VCHIQ_ERROR;
-			}
-			spin_lock(&quota_spinlock);
-			tx_end_index = SLOT_QUEUE_INDEX_FROM_POS(
-				state->local_tx_pos + stride - 1);
-		}
-
-		spin_unlock(&quota_spinlock);
+		status = wait_for_data_quota(state, service, 1, stride, size);
+		if (status != VCHIQ_SUCCESS)
+			return status;
 	}
 
 	header = reserve_space(state, stride, flags & QMFLAGS_IS_BLOCKING);
@@ -872,7 +929,6 @@ queue_message(VCHIQ_STATE_T *state, VCHIQ_SERVICE_T *service,
 
 	if (type == VCHIQ_MSG_DATA) {
 		int i, pos;
-		int tx_end_index;
 		int slot_use_count;
 
 		vchiq_log_info(vchiq_core_log_level,
@@ -907,29 +963,7 @@ queue_message(VCHIQ_STATE_T *state, VCHIQ_SERVICE_T *service,
 				header->data,
 				min(16, pos));
 
-		spin_lock(&quota_spinlock);
-		service_quota->message_use_count++;
-
-		tx_end_index =
-			SLOT_QUEUE_INDEX_FROM_POS(state->local_tx_pos - 1);
-
-		/* If this transmission can't fit in the last slot used by any
-		** service, the data_use_count must be increased. */
-		if (tx_end_index != state->previous_data_index) {
-			state->previous_data_index = tx_end_index;
-			state->data_use_count++;
-		}
-
-		/* If this isn't the same slot last used by this service,
-		** the service's slot_use_count must be increased. */
-		if (tx_end_index != service_quota->previous_tx_index) {
-			service_quota->previous_tx_index = tx_end_index;
-			slot_use_count = ++service_quota->slot_use_count;
-		} else {
-			slot_use_count = 0;
-		}
-
-		spin_unlock(&quota_spinlock);
+		slot_use_count = charge_data_quota(state, service_quota, 1);
 
 		if (slot_use_count)
 			vchiq_log_trace(vchiq_core_log_level,
@@ -993,6 +1027,105 @@ queue_message(VCHIQ_STATE_T *state, VCHIQ_SERVICE_T *service,
 	return VCHIQ_SUCCESS;
 }
 
+/* Called by application threads. Queues 'count' data messages, one element
+** each, reserving slot space once for as many of them as fit in a slot and
+** signalling the other side once at the end. '*queued' is set to how many
+** were queued, so that after a VCHIQ_RETRY the caller can carry on with the
+** rest. */
+static VCHIQ_STATUS_T
+queue_message_batch(VCHIQ_STATE_T *state, VCHIQ_SERVICE_T *service,
+	const VCHIQ_ELEMENT_T *messages, int count, int *queued)
+{
+	VCHIQ_SHARED_STATE_T *local = state->local;
+	VCHIQ_SERVICE_QUOTA_T *service_quota =
+		&state->service_quotas[service->localport];
+	int msgid = VCHIQ_MAKE_MSG(VCHIQ_MSG_DATA, service->localport,
+		service->remoteport);
+	VCHIQ_STATUS_T status = VCHIQ_SUCCESS;
+
+	*queued = 0;
+
+	while (*queued < count) {
+		const VCHIQ_ELEMENT_T *group = &messages[*queued];
+		unsigned int stride = 0;
+		int size = 0;
+		int n = 0;
+		int i;
+		char *pos;
+
+		/* Take as many messages as fit in one slot */
+		while ((*queued + n < count) &&
+			(stride + calc_stride(group[n].size) <=
+				VCHIQ_SLOT_SIZE)) {
+			stride += calc_stride(group[n].size);
+			size += group[n].size;
+			n++;
+		}
+
+		if (mutex_lock_interruptible(&state->slot_mutex) != 0) {
+			status = VCHIQ_RETRY;
+			break;
+		}
+
+		status = wait_for_data_quota(state, service, n, stride, size);
+		if (status != VCHIQ_SUCCESS)
+			break;
+
+		pos = (char *)reserve_space(state, stride, 1);
+		if (!pos) {
+			VCHIQ_SERVICE_STATS_INC(service, slot_stalls);
+			mutex_unlock(&state->slot_mutex);
+			status = VCHIQ_RETRY;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			VCHIQ_HEADER_T *header = (VCHIQ_HEADER_T *)pos;
+
+			if (group[i].size &&
+				(vchiq_copy_from_user(header->data,
+					group[i].data, (size_t)group[i].size)
+					!= VCHIQ_SUCCESS)) {
+				/* Pad out the rest of the reservation */
+				header->msgid = VCHIQ_MSGID_PADDING;
+				header->size = stride - sizeof(VCHIQ_HEADER_T);
+				VCHIQ_SERVICE_STATS_INC(service, error_count);
+				status = VCHIQ_ERROR;
+				break;
+			}
+
+			header->msgid = msgid;
+			header->size = group[i].size;
+
+			pos += calc_stride(group[i].size);
+			stride -= calc_stride(group[i].size);
+
+			VCHIQ_SERVICE_STATS_INC(service, ctrl_tx_count);
+			VCHIQ_SERVICE_STATS_ADD(service, ctrl_tx_bytes,
+				group[i].size);
+		}
+
+		if (i > 0)
+			charge_data_quota(state, service_quota, i);
+
+		/* Make the new headers and tx_pos visible to the peer. */
+		wmb();
+		local->tx_pos = state->local_tx_pos;
+		wmb();
+
+		mutex_unlock(&state->slot_mutex);
+
+		*queued += i;
+		if (status != VCHIQ_SUCCESS)
+			break;
+	}
+
+	if (*queued > 0)
+		remote_event_signal(&state->remote->trigger);
+
+	return status;
+}
+
 /* Called by the slot handler and application threads */
 static VCHIQ_STATUS_T
 queue_message_sync(VCHIQ_STATE_T *state, VCHIQ_SERVICE_T *service,
@@ -3495,6 +3628,64 @@ error_exit:
 	return status;
 }
 
+VCHIQ_STATUS_T
+vchiq_queue_messages(VCHIQ_SERVICE_HANDLE_T handle,
+	const VCHIQ_ELEMENT_T *messages, unsigned int count,
+	unsigned int *queued)
+{
+	VCHIQ_SERVICE_T *service = find_service_by_handle(handle);
+	VCHIQ_STATUS_T status = VCHIQ_ERROR;
+	int done = 0;
+
+	unsigned int i;
+
+	*queued = 0;
+
+	if (!service ||
+		(vchiq_check_service(service) != VCHIQ_SUCCESS))
+		goto error_exit;
+
+	for (i = 0; i < count; i++) {
+		if ((messages[i].size && (messages[i].data == NULL)) ||
+			(messages[i].size > VCHIQ_MAX_MSG_SIZE)) {
+			VCHIQ_SERVICE_STATS_INC(service, error_count);
+			goto error_exit;
+		}
+	}
+
+	switch (service->srvstate) {
+	case VCHIQ_SRVSTATE_OPEN:
+		status = queue_message_batch(service->state, service,
+				messages, (int)count, &done);
+		break;
+	case VCHIQ_SRVSTATE_OPENSYNC:
+		/* Synchronous messages go one at a time */
+		status = VCHIQ_SUCCESS;
+		while ((status == VCHIQ_SUCCESS) && (done < (int)count)) {
+			status = queue_message_sync(service->state, service,
+					VCHIQ_MAKE_MSG(VCHIQ_MSG_DATA,
+						service->localport,
+						service->remoteport),
+					&messages[done], 1,
+					messages[done].size, 1);
+			if (status == VCHIQ_SUCCESS)
+				done++;
+		}
+		break;
+	default:
+		status = VCHIQ_ERROR;
+		break;
+	}
+
+	*queued = done;
+
+error_exit:
+	if (service)
+		unlock_service(service);
+
+	return status;
+}
+
 void
 vchiq_release_message(VCHIQ_SERVICE_HANDLE_T handle, VCHIQ_HEADER_T *header)
 {
@@ -152,6 +152,10 @@ extern VCHIQ_STATUS_T vchiq_release_service(VCHIQ_SERVICE_HANDLE_T service);
 
 extern VCHIQ_STATUS_T vchiq_queue_message(VCHIQ_SERVICE_HANDLE_T service,
 	const VCHIQ_ELEMENT_T *elements, unsigned int count);
+extern VCHIQ_STATUS_T vchiq_queue_messages(VCHIQ_SERVICE_HANDLE_T service,
+	const VCHIQ_ELEMENT_T *messages, unsigned int count,
+	unsigned int *queued);
+extern unsigned int   vchiq_get_doorbell_count(void);
 extern void           vchiq_release_message(VCHIQ_SERVICE_HANDLE_T service,
 	VCHIQ_HEADER_T *header);
 extern VCHIQ_STATUS_T vchiq_queue_bulk_transmit(VCHIQ_SERVICE_HANDLE_T service,
@@ -395,6 +395,54 @@ int32_t vchi_msg_queuev(VCHI_SERVICE_HANDLE_T handle,
 }
 EXPORT_SYMBOL(vchi_msg_queuev);
 
+/***********************************************************
+ * Name: vchi_msg_queue_batch
+ *
+ * Arguments:  VCHI_SERVICE_HANDLE_T handle,
+ *             VCHI_MSG_VECTOR_T *messages,
+ *             uint32_t count,
+ *             VCHI_FLAGS_T flags,
+ *             void *msg_handle
+ *
+ * Description: Queues each vector element as a message of its own, with
+ *              one slot reservation for as many as fit in a slot and one
+ *              signal to the other side
+ *
+ * Returns: int32_t - success == 0
+ *
+ ***********************************************************/
+int32_t vchi_msg_queue_batch(VCHI_SERVICE_HANDLE_T handle,
+	VCHI_MSG_VECTOR_T *messages,
+	uint32_t count,
+	VCHI_FLAGS_T flags,
+	void *msg_handle)
+{
+	SHIM_SERVICE_T *service = (SHIM_SERVICE_T *)handle;
+	const VCHIQ_ELEMENT_T *elements = (const VCHIQ_ELEMENT_T *)messages;
+	unsigned int queued;
+	VCHIQ_STATUS_T status;
+
+	(void)msg_handle;
+
+	WARN_ON(flags != VCHI_FLAGS_BLOCK_UNTIL_QUEUED);
+
+	status = vchiq_queue_messages(service->handle, elements, count,
+		&queued);
+
+	/* As in vchi_msg_queue, retry until queued, but only with the
+	** messages that didn't make it */
+	while (status == VCHIQ_RETRY) {
+		elements += queued;
+		count -= queued;
+		msleep(1);
+		status = vchiq_queue_messages(service->handle, elements,
+			count, &queued);
+	}
+
+	return vchiq_status_to_vchi(status);
+}
+EXPORT_SYMBOL(vchi_msg_queue_batch);
+
 /***********************************************************
  * Name: vchi_held_msg_release
  *
@@ -22,6 +22,11 @@ void MsDelay (unsigned nMilliSeconds)
 	usDelay(nMilliSeconds * 1000);
 }
 
+unsigned GetMicroseconds (void)
+{
+	return *SYSTMR_CLO;
+}
+
 static TPeriodicTimerHandler *periodic = NULL;
 
 void RegisterPeriodicHandler (TPeriodicTimerHandler *pHandler)
@@ -82,8 +87,7 @@ void ConnectInterrupt (unsigned nIRQ, TInterruptHandler *pHandler, void *pParam)
 	set_irq_handler(nIRQ, pHandler, pParam);
 }
 
-// 100 Hz
-#define T1_INTV	(1000000 / 100)
+#define T1_INTV	(1000000 / AMPI_TICK_HZ)
 
 void timer1_handler(void *_unused)
 {
@@ -1,6 +1,8 @@
 #ifndef LSM6DS33_H
 #define LSM6DS33_H
 
+#include <stdbool.h>
+
 /*
  * Module to interact with the LSM6DS33 6DOF IMU over I2C. This is designed for use
  * with the Adafruit LSM6DS33 breakout https://www.adafruit.com/product/4480 but would
@@ -15,6 +17,11 @@
 #define LSM6DS33_I2CADDR_ALTERNATE 0x6B // Alternate (solder jumper on Adafruit breakout)
 // Important registers
 #define LSM6DS33_FUNC_CFG_ACCESS 0x01 // Enable embedded functions register
+#define LSM6DS33_FIFO_CTRL1 0x06	  // FIFO watermark, lower 8 bits
+#define LSM6DS33_FIFO_CTRL2 0x07	  // FIFO watermark, upper 4 bits
+#define LSM6DS33_FIFO_CTRL3 0x08	  // Gyro and accel FIFO decimation register
+#define LSM6DS33_FIFO_CTRL4 0x09	  // Third FIFO data set decimation register
+#define LSM6DS33_FIFO_CTRL5 0x0A	  // FIFO data rate and mode register
 #define LSM6DS33_INT1_CTRL 0x0D		  // Interrupt 1 control register
 #define LSM6DS33_INT2_CTRL 0x0E		  // Interrupt 2 control register
 #define LSM6DS33_WHOAMI 0x0F		  // Chip ID register
@@ -39,11 +46,47 @@
 #define LSM6DS33_OUTY_H_XL 0x31
 #define LSM6DS33_OUTZ_L_XL 0x32
 #define LSM6DS33_OUTZ_H_XL 0x33
+#define LSM6DS33_FIFO_STATUS1 0x3A	// Unread FIFO words, lower 8 bits (sequential)
+#define LSM6DS33_FIFO_STATUS2 0x3B	// FIFO flags and unread words, upper 4 bits
+#define LSM6DS33_FIFO_STATUS3 0x3C	// Next FIFO word's place in the pattern, lower 8 bits
+#define LSM6DS33_FIFO_STATUS4 0x3D	// Next FIFO word's place in the pattern, upper 2 bits
+#define LSM6DS33_FIFO_DATA_OUT_L 0x3E	// FIFO output, rolls back to itself after _H in a burst
+#define LSM6DS33_FIFO_DATA_OUT_H 0x3F
 #define LSM6DS33_TAP_CFG 0x58	 // Tap/pedometer configuration register
 #define LSM6DS33_WAKEUP_THS 0x5B // Single and double-tap function threshold register
 #define LSM6DS33_WAKEUP_DUR 0x5C // Free-fall, wakeup, timestamp and sleep mode duration register
 #define LSM6DS33_MD1_CFG 0x5E	 // Functions routing on INT1 register
 
+// CTRL3_C bits
+#define LSM6DS33_CTRL3_BDU 0x40	   // Block data update: output registers hold until both bytes are read
+#define LSM6DS33_CTRL3_IF_INC 0x04 // Register address auto-increment in multi-byte reads
+
+// I2C bus speed. A FIFO sample is 12 bytes, about 108 bit times with the acks,
+// so at LSM6DS33_RATE_833_HZ the samples alone take 90 kbit/s per sensor (23%
+// of 400 kHz), and at LSM6DS33_RATE_1_66_KHZ twice that. Each FIFO read adds
+// about 100 bit times for the status read and register addresses on top
+#ifndef LSM6DS33_I2C_HZ
+#define LSM6DS33_I2C_HZ 400000
+#endif
+
+// Events that can be routed to the INT1 pin (INT1_CTRL bits)
+#define LSM6DS33_INT1_FULL_FLAG 0x20 // FIFO full
+#define LSM6DS33_INT1_FIFO_OVR 0x10	 // FIFO overrun
+#define LSM6DS33_INT1_FTH 0x08		 // FIFO watermark reached
+#define LSM6DS33_INT1_DRDY_G 0x02	 // New gyro sample
+#define LSM6DS33_INT1_DRDY_XL 0x01	 // New accel sample
+
+// FIFO_STATUS2 flags
+#define LSM6DS33_FIFO_WATERMARK 0x80
+#define LSM6DS33_FIFO_OVERRUN 0x40
+#define LSM6DS33_FIFO_FULL 0x20
+#define LSM6DS33_FIFO_EMPTY 0x10
+
+// The FIFO holds 8 KB of 16-bit words; each sample is gyro XYZ then accel XYZ
+#define LSM6DS33_FIFO_WORDS 4096
+#define LSM6DS33_FIFO_SAMPLE_WORDS 6
+#define LSM6DS33_FIFO_MAX_SAMPLES (LSM6DS33_FIFO_WORDS / LSM6DS33_FIFO_SAMPLE_WORDS)
+
 // Data rates (for accel and gyro)
 typedef enum data_rate {
 	LSM6DS33_RATE_POWERDOWN = 0,
@@ -84,12 +127,6 @@ typedef enum hpf_range {
 	LSM6DS_HPF_ODR_DIV_400,
 } lsm6ds33_hp_filter_t;
 
-// Used to access multiple sensors
-typedef enum lsm6ds33_sensor_id {
-	LSM6DS33_SENSOR0 = 0,
-	LSM6DS33_SENSOR1
-} lsm6ds33_sensor_id_t;
-
 // Used to access a specific axis of accel or gyro
 typedef enum lsm6ds33_axis {
 	LSM6DS33_AXIS_X = 0,
@@ -97,6 +134,21 @@ typedef enum lsm6ds33_axis {
 	LSM6DS33_AXIS_Z = 2,
 } lsm6ds33_axis_t;
 
+// Readings as the sensor stores them, gyro XYZ then accel XYZ
+typedef struct lsm6ds33_raw {
+	short gyro[3];
+	short accel[3];
+} lsm6ds33_raw_t;
+
+// Axes for lsm6ds33_convert to fill in; a mask of these
+#define LSM6DS33_GYRO_X 0x01
+#define LSM6DS33_GYRO_Y 0x02
+#define LSM6DS33_GYRO_Z 0x04
+#define LSM6DS33_ACCEL_X 0x08
+#define LSM6DS33_ACCEL_Y 0x10
+#define LSM6DS33_ACCEL_Z 0x20
+#define LSM6DS33_ALL_AXES 0x3F
+
 typedef struct lsm6ds33_data {
 	double accelx;
 	double accely;
@@ -106,63 +158,151 @@ typedef struct lsm6ds33_data {
 	double gyroz;
 } lsm6ds33_data_t;
 
-/* Initializes a single LSM6DS33 sensor at the given address
- * and with the given data rate.
+/* One sensor. Each is configured and read on its own through its handle, so
+ * several can run with different settings and be read back to back.
+ * Set up with lsm6ds33_init; the fields are only for reading.
  */
-void lsm6ds33_init(int addr, lsm6ds33_data_rate_t rate);
+typedef struct lsm6ds33_dev {
+	int addr;
+	lsm6ds33_accel_range_t accel_range;
+	lsm6ds33_gyro_range_t gyro_range;
+	float accel_scale; // units of lsm6ds33_data_t per raw reading, see lsm6ds33_convert
+	float gyro_scale;
+	unsigned int fifo_overruns; // times the FIFO overwrote samples before they were read
+	bool fifo_discard;			// the first sample after enabling the FIFO is unreliable
+	unsigned int fifo_watermark; // samples, as set by lsm6ds33_enable_fifo
+	unsigned int fifo_period_us; // between FIFO samples
+	unsigned char fifo_status[4]; // FIFO_STATUS1..4 as last read
+	bool fifo_status_cached;	  // read by lsm6ds33_take_int1_event and not used yet
+	bool int1_attached;
+	unsigned int int1_pin;
+	volatile bool int1_pending; // written by the GPIO interrupt handler
+	volatile unsigned int int1_time;
+} lsm6ds33_dev_t;
 
-/* Initializes two LSM6DS33 sensors at the given addresses
- * and with the given data rate.
- *
- */
-void lsm6ds33_init_dual(int addr1, int addr2, lsm6ds33_data_rate_t rate);
+// Most sensors whose INT1 can be attached at once
+#define LSM6DS33_MAX_INT1_DEVICES 4
 
-/* Set the active sensor. Future calls to library functions
- * will use this sensor until this function is called again.
- * Has no effect if initialized in single-sensor mode.
+/* Initializes the LSM6DS33 sensor at the given address with the given
+ * data rate, 4 g accel range and 250 dps gyro range. Block data update and
+ * address auto-increment are turned on, so burst reads never mix samples.
+ * A 'dev' attached with lsm6ds33_attach_int1 is detached first.
  */
-void lsm6ds33_set_active_sensor(lsm6ds33_sensor_id_t id);
+void lsm6ds33_init(lsm6ds33_dev_t *dev, int addr, lsm6ds33_data_rate_t rate);
 
-/* Set the accelerometer data rate of the currently active sensor.
+/* Set the accelerometer data rate.
  * Returns 1 if successful, 0 if unsuccessful.
  */
-unsigned int lsm6ds33_set_accel_data_rate(lsm6ds33_data_rate_t rate);
+unsigned int lsm6ds33_set_accel_data_rate(lsm6ds33_dev_t *dev, lsm6ds33_data_rate_t rate);
 
-/* Set the gyro data rate of the currently active sensor.
+/* Set the gyro data rate.
  * Returns 1 if successful, 0 if unsuccessful.
  */
-unsigned int lsm6ds33_set_gyro_data_rate(lsm6ds33_data_rate_t rate);
+unsigned int lsm6ds33_set_gyro_data_rate(lsm6ds33_dev_t *dev, lsm6ds33_data_rate_t rate);
 
-/* Set the accelerometer range of the currently active sensor.
+/* Set the accelerometer range, and the scale readings are converted with.
  * Returns 1 if successful, 0 if unsuccessful.
  */
-unsigned int lsm6ds33_set_accel_range(lsm6ds33_accel_range_t range);
+unsigned int lsm6ds33_set_accel_range(lsm6ds33_dev_t *dev, lsm6ds33_accel_range_t range);
 
-/* Set the gyro range of the currently active sensor.
+/* Set the gyro range, and the scale readings are converted with.
  * Returns 1 if successful, 0 if unsuccessful.
  */
-unsigned int lsm6ds33_set_gyro_range(lsm6ds33_gyro_range_t range);
+unsigned int lsm6ds33_set_gyro_range(lsm6ds33_dev_t *dev, lsm6ds33_gyro_range_t range);
 
 /* Read all accelerometer and gyro axes. The data struct is populated
  * with gyro measurements in degrees per second and accelerometer
  * measurements in milli g's. 
  */
-void lsm6ds33_get_all(lsm6ds33_data_t *data);
+void lsm6ds33_get_all(lsm6ds33_dev_t *dev, lsm6ds33_data_t *data);
+
+/* Read all accelerometer and gyro axes unscaled, in one transaction. */
+void lsm6ds33_get_all_raw(lsm6ds33_dev_t *dev, lsm6ds33_raw_t *raw);
+
+/* Scales 'count' raw samples from the sensor into 'data', filling in only
+ * the fields for 'axes' (a mask of LSM6DS33_GYRO_X etc.) and leaving the rest
+ * as they were.
+ */
+void lsm6ds33_convert(const lsm6ds33_dev_t *dev, const lsm6ds33_raw_t *raw, unsigned int count,
+					  unsigned int axes, lsm6ds33_data_t *data);
+
+/* Puts the FIFO in continuous mode, storing every gyro and accel sample
+ * (no decimation) at the given data rate, which should match the sensor's.
+ * The watermark flag rises once 'watermark' samples are waiting. Samples
+ * older than the last LSM6DS33_FIFO_MAX_SAMPLES are overwritten if the FIFO
+ * isn't read in time.
+ * Returns 1 if successful, 0 if unsuccessful.
+ */
+unsigned int lsm6ds33_enable_fifo(lsm6ds33_dev_t *dev, lsm6ds33_data_rate_t rate, unsigned int watermark);
+
+/* Stops and empties the FIFO.
+ * Returns 1 if successful, 0 if unsuccessful.
+ */
+unsigned int lsm6ds33_disable_fifo(lsm6ds33_dev_t *dev);
+
+/* Reads up to 'max_samples' of the samples waiting in the FIFO into
+ * 'samples', oldest first, in the units of lsm6ds33_get_all. All of them come
+ * in one burst read, after one read of the FIFO status (and one more to drop
+ * a partial sample after an overrun). If lsm6ds33_take_int1_event read the
+ * status to stamp the samples, that is used instead, and only the samples it
+ * counted are read. Consecutive samples are one period of
+ * the FIFO data rate apart (see lsm6ds33_sample_period_us), with none missing
+ * unless the FIFO overran.
+ * Returns the number of samples read.
+ */
+unsigned int lsm6ds33_read_fifo(lsm6ds33_dev_t *dev, lsm6ds33_data_t *samples, unsigned int max_samples);
+
+/* Like lsm6ds33_read_fifo, but leaves the samples unscaled and reads them
+ * straight into 'samples'.
+ * Returns the number of samples read.
+ */
+unsigned int lsm6ds33_read_fifo_raw(lsm6ds33_dev_t *dev, lsm6ds33_raw_t *samples, unsigned int max_samples);
+
+/* Routes the given events (LSM6DS33_INT1_* bits, replacing any routed before)
+ * to the sensor's INT1 pin. The pin stays high for as long as the events
+ * hold, e.g. until the FIFO is read below its watermark.
+ * Returns 1 if successful, 0 if unsuccessful.
+ */
+unsigned int lsm6ds33_route_int1(lsm6ds33_dev_t *dev, char events);
+
+/* Watches GPIO 'pin', wired to the sensor's INT1 pin, for rising edges, and
+ * records the time of each one from the GPIO interrupt. Interrupts must be
+ * enabled globally for the events to be stamped as they happen. Attaching an
+ * attached sensor again moves it to 'pin'.
+ * Returns 1 if successful, 0 if LSM6DS33_MAX_INT1_DEVICES are attached already.
+ */
+unsigned int lsm6ds33_attach_int1(lsm6ds33_dev_t *dev, unsigned int pin);
+
+/* Returns true if the sensor's INT1 rose since the last call, or is still
+ * high because more samples arrived while the last ones were read. '*time'
+ * gets when the oldest sample waiting in the FIFO was taken, in
+ * timer_get_ticks() units, so the samples lsm6ds33_read_fifo returns next are
+ * at '*time' and a period apart from there. With the FIFO enabled and drained
+ * each time, that is a watermark's worth of periods before the interrupt; if
+ * INT1 stayed high there was no edge, so it is worked out from how many
+ * samples are waiting now instead, which takes a read of the FIFO status that
+ * the next lsm6ds33_read_fifo reuses. Without the FIFO it is the interrupt time
+ * (or now).
+ */
+bool lsm6ds33_take_int1_event(lsm6ds33_dev_t *dev, unsigned int *time);
+
+/* Time between samples at the given data rate, in microseconds */
+unsigned int lsm6ds33_sample_period_us(lsm6ds33_data_rate_t rate);
 
 /* Read the accelerometer on the given axis */
-unsigned int lsm6ds33_get_accel_single_axis(lsm6ds33_axis_t axis);
+unsigned int lsm6ds33_get_accel_single_axis(lsm6ds33_dev_t *dev, lsm6ds33_axis_t axis);
 
 /* Read the accelerometer on the given axis */
-unsigned int lsm6ds33_get_gyro_single_axis(lsm6ds33_axis_t axis);
+unsigned int lsm6ds33_get_gyro_single_axis(lsm6ds33_dev_t *dev, lsm6ds33_axis_t axis);
 
-/* Reads a single register from the currently active sensor.
+/* Reads a single register.
  * Returns the value in that register.
  */
-char lsm6ds33_read_register(char reg);
+char lsm6ds33_read_register(lsm6ds33_dev_t *dev, char reg);
 
-/* Writes a single register to the currently active sensor.
+/* Writes a single register.
  * Returns 1 if successful, 0 if unsuccessful.
  */
-unsigned int lsm6ds33_write_register(char reg, char data);
+unsigned int lsm6ds33_write_register(lsm6ds33_dev_t *dev, char reg, char data);
 
 #endif
\ No newline at end of file
@@ -5,43 +5,138 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+// Polyphony limit; override with NUM_TRACKS=n on the make command line
+#ifndef NUM_TRACKS
 #define NUM_TRACKS 8
-#define SAMPLE_RATE 44100
+#endif
+// Extra slots where stolen tracks fade out while their replacement starts
+#define TRACK_RELEASE_SLOTS 2
+#define NUM_TRACK_SLOTS (NUM_TRACKS + TRACK_RELEASE_SLOTS)
+// Length of the fade applied to a stolen track (~1.5 ms), in TRACK_RELEASE_STEP steps
+#define TRACK_RELEASE_FRAMES 64
+#define TRACK_RELEASE_STEP 8
+
+// Which track gets stolen when all NUM_TRACKS are busy
+#define TRACK_STEAL_QUIETEST 0  // lowest level, oldest first among equals
+#define TRACK_STEAL_OLDEST 1
+#ifndef TRACK_STEAL_POLICY
+#define TRACK_STEAL_POLICY TRACK_STEAL_QUIETEST
+#endif
+
+#define NUM_SEQUENCES 32
+// Default output rate; override with OUTPUT_RATE=n on the make command line.
+// The recordings in media/ are MEDIA_SAMPLE_RATE and get resampled on loading
+#ifndef SAMPLE_RATE
+#define SAMPLE_RATE 48000
+#endif
+#define MEDIA_SAMPLE_RATE 44100
+// Most recordings that can be resampled and kept at the output rate at once
+#define NUM_SAMPLE_BANKS 16
+
+// Voice gains are Q16.16 fixed point so the mixer never has to touch the FPU
+#define AUDIO_GAIN_SHIFT 16
+#define AUDIO_GAIN_ONE (1 << AUDIO_GAIN_SHIFT)
+
+// Strike velocities, as reported by read_angle, run from 1 to MAX_VELOCITY
+#define MAX_VELOCITY 127
+
+// Pan positions run from PAN_LEFT to PAN_RIGHT; PAN_CENTER plays at the same
+// level on both sides as an unpanned track used to
+#define PAN_LEFT 0
+#define PAN_CENTER 32
+#define PAN_RIGHT 64
 
 #define INIT_AUDIO(_aud_) extern unsigned char media_##_aud_##_raw[]; extern size_t media_##_aud_##_raw_len;
-#define MAKE_AUDIO(_aud_, _vol_) createAudio((int16_t*) media_##_aud_##_raw, media_##_aud_##_raw_len / sizeof(int16_t), _vol_)
-#define MAKE_SILENCE(_time_) createAudio(NULL, (size_t) (_time_ * SAMPLE_RATE), 0.0)
+#define MAKE_AUDIO(_aud_, _vol_) loadAudio((int16_t*) media_##_aud_##_raw, media_##_aud_##_raw_len / sizeof(int16_t), MEDIA_SAMPLE_RATE, _vol_)
+#define MAKE_SILENCE(_time_) createAudio(NULL, (size_t) (_time_ * getOutputRate()), 0.0)
 
 struct audio_file
 {
     int16_t *audio_samples;
-    size_t index;
     size_t audio_len;
     float volume;
+    int32_t gain;  // 'volume' in Q16.16, precomputed by createAudio
 };
 
+// Sequences are only read once registered; playback state lives in struct track
 struct audio_sequence
 {
     struct audio_file audios[16];
-    size_t index;
     size_t len;
+};
+
+// A sequence being played
+struct track
+{
+    const struct audio_sequence *seq;
+    size_t index;     // current entry in seq->audios
+    size_t position;  // next sample within that entry
+    size_t delay;     // frames before the track starts, which may run past this chunk
+    int32_t gainL;    // Q16.16 trigger gain and pan for each side,
+    int32_t gainR;    // applied on top of each entry's gain
+    size_t age;       // frames played so far
+    int32_t level;    // rough peak of the last chunk this track mixed
+    size_t release;   // frames of fade left once isReleasing is set
+    bool isReleasing;
     bool isRunning;
 };
 
+struct track_stats
+{
+    unsigned int started;
+    unsigned int stolen;   // tracks faded out early to make room for a new one
+    unsigned int dropped;  // triggers that couldn't get a track at all
+};
+
 struct audio_file createAudio(int16_t *samples, size_t audio_len, float volume);
 
-// Returns true if adding the track was successful
-bool addTrack(struct audio_sequence* seq);
+// Like createAudio, for samples recorded at 'sample_rate': if that isn't the
+// output rate, the samples are resampled once here and the copy is kept, so
+// loading the same recording again reuses it and the mixer never resamples
+// Call after setOutputRate (synth_init). Asserts if there is no memory (or no
+// free bank) for the copy, rather than playing at the wrong pitch. The copies
+// take the recording's size times output rate / sample rate from the heap, plus
+// 20 KB for the resampler's filter: about 215 KB for the four drums main.c
+// loads at 48 kHz
+struct audio_file loadAudio(int16_t *samples, size_t audio_len, unsigned int sample_rate, float volume);
+
+// The rate chunks are mixed at, which trigger timestamps and MAKE_SILENCE
+// lengths are converted with. Set it before loading anything
+void setOutputRate(unsigned int sample_rate);
+unsigned int getOutputRate(void);
+
+// Looks up the Q16.16 trigger gain for a strike velocity (see MAX_VELOCITY)
+int32_t velocityGain(unsigned int velocity);
+
+// Makes 'seq' available to triggerSequence. 'seq' must stay valid for as long
+// as it may be played. Returns the sequence id, or -1 if the table is full
+int registerSequence(const struct audio_sequence* seq);
+
+// Queues the sequence 'seq_id' to start playing at the frame matching
+// 'timestamp' (timer_get_ticks() at the time of the hit) so that hits stay
+// evenly spaced however they line up with chunk boundaries
+// 'gain' is Q16.16; 'pan' is between PAN_LEFT and PAN_RIGHT
+// Safe to call while audio is running; never blocks
+// Returns true if the trigger was queued
+bool triggerSequence(int seq_id, int32_t gain, uint8_t pan, unsigned int timestamp);
+
+// Copies the track allocation counters into 'stats'; safe to call while audio is running
+void getTrackStats(struct track_stats *stats);
 
-// Adds 'buflen' stereo samples to buf (i.e. buflen / 2 distinct samples); 'buflen' must be even
-// Also advances the index of the corresponding sequence
+// Adds 'frames' samples onto the 32-bit interleaved stereo mix bus (no clipping happens here)
+// Also advances the track
 // Returns true if the track is over
-bool dumpMusic(struct audio_sequence* seq, int16_t *buf, size_t buflen);
+bool dumpMusic(struct track* track, int32_t *bus, size_t frames);
 
-// Dumps all the tracks onto buf
-// Essentially, calls dumpMusic for each track
+// Starts any queued triggers, then dumps all the tracks onto buf as 'buflen' stereo samples (i.e. buflen / 2 distinct samples); 'buflen' must be even
+// Essentially, calls dumpMusic for each track on 'bus', which needs room for buflen entries,
+// then saturates the bus into buf once
+// 'start' is the trigger timestamp that frame 0 of this chunk plays for: a trigger
+// stamped 'start' + t plays t into the chunk (or into a later one), one stamped
+// before 'start' plays at once. The caller sets 'start' a fixed latency behind
+// the time the chunk will actually be heard, so every hit is delayed the same
 // The index for each track moves up
-void dumpAllTracks(int16_t *buf, size_t buflen);
+void dumpAllTracks(int16_t *buf, int32_t *bus, size_t buflen, unsigned int start);
 
 
 void debugTracks(void);
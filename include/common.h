@@ -107,6 +107,10 @@ uint32_t recv_mail(uint8_t channel);
 
 void env_init();
 
+// Asks the VideoCore for the core (VPU) clock in Hz, which clocks the
+// peripherals such as the I2C controllers; 0 if it couldn't say
+uint32_t GetCoreClockRate(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,43 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "audio_sequence.h"
+
+/*
+ * A kit piece made of velocity layers (e.g. soft/medium/hard hits), each with a
+ * few round-robin alternatives so repeated hits don't all sound identical.
+ * Every alternative is a registered sequence, which only points at its sample
+ * data, so picking one never copies samples. A hit looks its layer up by
+ * velocity and takes the layer's next alternative, both in constant time.
+ */
+
+#define INSTRUMENT_MAX_LAYERS 4
+#define INSTRUMENT_MAX_ALTERNATIVES 4
+
+struct instrument
+{
+    uint8_t layerOfVelocity[MAX_VELOCITY + 1];  // velocity -> index into seqIds
+    uint8_t numLayers;
+    uint8_t minVelocity[INSTRUMENT_MAX_LAYERS];
+    uint8_t numAlternatives[INSTRUMENT_MAX_LAYERS];
+    uint8_t nextAlternative[INSTRUMENT_MAX_LAYERS];  // round-robin position
+    uint8_t seqIds[INSTRUMENT_MAX_LAYERS][INSTRUMENT_MAX_ALTERNATIVES];
+};
+
+void initInstrument(struct instrument *inst);
+
+// Adds the registered sequence 'seq_id' as an alternative played for hits of
+// 'min_velocity' and up, until the next layer takes over. Alternatives sharing
+// a 'min_velocity' form one layer; layers must be added softest first. Hits
+// softer than the first layer still play it
+// Returns false if the instrument is full or the layers are out of order
+bool addInstrumentSample(struct instrument *inst, unsigned int min_velocity, int seq_id);
+
+// Triggers the alternative due next in the layer for 'velocity', at the gain
+// velocityGain gives for it. Only call from one thread (the main loop)
+// Returns false if the trigger couldn't be queued
+bool triggerInstrument(struct instrument *inst, unsigned int velocity, uint8_t pan, unsigned int timestamp);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef MIX_H
+#define MIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Mixing kernels for the audio callback. Voices are summed into a 32-bit mix
+ * bus without any clipping, and the bus is saturated to int16 once when it is
+ * written out, so the result doesn't depend on the order voices are mixed in.
+ * The bus keeps MIX_FRAC_BITS below the output LSB and is rounded once when it
+ * is written out, so the mix is rounded once rather than once per voice and
+ * stays within 1 LSB of the exact sum of the scaled samples.
+ *
+ * The bus is interleaved left/right like the output. Each mono sample is
+ * loaded once and added to both sides with its own gain, so a panned voice
+ * costs exactly what a centred one does.
+ *
+ * The *_c kernels are the plain C reference; the *_armv6 kernels do the same
+ * work with the ARMv6 DSP/media instructions (smlawb/smlawt, ssat, pkhbt), two
+ * frames per iteration. On other targets the instructions are emulated in C so
+ * both sets of kernels can be compared on the host.
+ *
+ * 'buf' must be word aligned, since the ARMv6 kernels treat each stereo frame
+ * as a single 32-bit word.
+ */
+
+// Fraction bits the bus carries. Gains must stay below 1 << (31 - MIX_FRAC_BITS)
+// in Q16.16 (128.0), and the bus has headroom for a few hundred voices at 5.0
+#define MIX_FRAC_BITS 8
+
+// Adds 'frames' mono samples onto 'frames' stereo frames of the mix bus, scaled
+// by the Q16.16 'gainL' on the left and 'gainR' on the right
+void mix_accumulate_c(int32_t *bus, const int16_t *samples, size_t frames, int32_t gainL, int32_t gainR);
+void mix_accumulate_armv6(int32_t *bus, const int16_t *samples, size_t frames, int32_t gainL, int32_t gainR);
+
+// Rounds 'frames' stereo frames of the mix bus to the nearest output step,
+// saturates them to int16 and writes them to the interleaved stereo buffer 'buf'
+void mix_write_c(int16_t *buf, const int32_t *bus, size_t frames);
+void mix_write_armv6(int16_t *buf, const int32_t *bus, size_t frames);
+
+#if defined(__ARM_FEATURE_DSP) && defined(__ARM_FEATURE_SIMD32)
+#define MIX_ARMV6 1
+#define mix_accumulate mix_accumulate_armv6
+#define mix_write mix_write_armv6
+#else
+#define mix_accumulate mix_accumulate_c
+#define mix_write mix_write_c
+#endif
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef PCM_RING_H
+#define PCM_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "synth.h"
+
+/*
+ * Ring of mixed chunks between the render step, which fills it ahead of time,
+ * and the AMPi chunk callback, which only hands the oldest chunk over. Each
+ * chunk is rendered in place and sent from where it lies, so nothing is copied.
+ * One producer and one consumer; neither ever waits on the other.
+ *
+ * The depth is how many chunks are rendered ahead: deeper rides out longer
+ * stalls in the render step, but every chunk of depth adds a chunk of latency.
+ */
+
+#define PCM_RING_MAX_DEPTH 8
+#ifndef PCM_RING_DEPTH
+#define PCM_RING_DEPTH 2
+#endif
+// Besides the rendered-ahead chunks, the chunk handed over last and the one
+// before it may still be in use for a bulk transfer
+#define PCM_RING_SLOTS (PCM_RING_MAX_DEPTH + 2)
+#define PCM_RING_CHUNK_LEN (2 * SYNTH_MAX_CHUNK_FRAMES)  // int16 elements
+
+struct pcm_ring_stats
+{
+    unsigned int depth;
+    unsigned int fill;       // chunks rendered and not yet handed over
+    unsigned int minFill;    // lowest fill the consumer has found
+    unsigned int rendered;   // chunks committed
+    unsigned int underruns;  // reads that found the ring empty
+    // Render steps that found the ring already full and had nothing to do.
+    // That is the usual idle state between chunks, not an error
+    unsigned int fullTicks;
+};
+
+// Sets how many chunks to render ahead (1..PCM_RING_MAX_DEPTH); returns false
+// if out of range. A smaller depth takes effect as the ring drains
+bool pcm_ring_set_depth(unsigned int depth);
+unsigned int pcm_ring_get_depth(void);
+
+// Producer side. pcm_ring_space is how many chunks can be written before the
+// ring is at its depth. When there is space, render into pcm_ring_write_slot
+// (PCM_RING_CHUNK_LEN elements) and publish it with pcm_ring_commit
+unsigned int pcm_ring_space(void);
+int16_t *pcm_ring_write_slot(void);
+void pcm_ring_commit(size_t len);
+void pcm_ring_count_full_tick(void);
+
+// Consumer side. Returns the oldest chunk and its length in elements, or NULL
+// if the ring is empty. The chunk stays untouched until the second read after it
+const int16_t *pcm_ring_read(size_t *len);
+
+void pcm_ring_get_stats(struct pcm_ring_stats *stats);
+// Restarts minFill and the counters (but not the ring itself)
+void pcm_ring_reset_stats(void);
+
+#endif
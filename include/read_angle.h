@@ -7,7 +7,15 @@
 // 180 / pi
 #define DEGREES_PER_RADIAN 57.29577951308232
 #define ANGLE_BUFFER_LEN 4
-#define ANGLE_BUFFER_NUM_SAMPLES 10
+// Each slot of the angle buffer averages the angle over ANGLE_BUFFER_SLOT_US when
+// samples are ANGLE_BUFFER_REFERENCE_PERIOD_US apart (10 samples at 208 Hz). The noise
+// on alpha goes as sqrt(sample period) / slot^2.5, so at faster rates the slots
+// shrink just enough to keep it the same, and hits are seen sooner
+#define ANGLE_BUFFER_SLOT_US 48000
+#define ANGLE_BUFFER_REFERENCE_PERIOD_US 4808
+// How long the angle takes to settle on what the accel says, in seconds; shorter
+// is more responsive, longer is more accurate in the long run
+#define ANGLE_FILTER_TIME 4.8
 
 enum Axes {
     X_AXIS = 0,
@@ -28,11 +36,14 @@ struct gesture_handler {
     double angle;  // in degrees
     double omega;  // angular velocity
     double alpha;  // angular acceleration
+    unsigned int strikeVelocity;  // 1..MAX_VELOCITY, how hard the last detected hit was
     double angleBuffer[ANGLE_BUFFER_LEN];
     double calibration;
     unsigned int m_lastUpDownGestureTime;
     unsigned int m_lastUpdateTime;
     unsigned int angleBufferSamples;
+    unsigned int angleBufferSlotSamples;  // samples averaged into each slot
+    double angleBufferTime;  // seconds covered by the samples in the last slot so far
     axis_t hAxis;
     axis_t vAxis;
     axis_t angleAxis;
@@ -48,17 +59,31 @@ typedef struct gesture_handler gesture_handler_t;
  *                   In other words, which of the axes (X, Y, or Z) points horizontally away from you
  *                   if you hold the stick?
  * @param vertical   This is the direction that should be considered up and vertical
+ * @param sample_period_us Time between the samples that will be passed to updateAngle
  */
-gesture_handler_t createGestureReader(axis_t horizontal, axis_t vertical);
+gesture_handler_t createGestureReader(axis_t horizontal, axis_t vertical, unsigned int sample_period_us);
 
-void calibrate(gesture_handler_t* reader);
+void calibrate(gesture_handler_t* reader, lsm6ds33_dev_t* dev);
+
+/**
+ * The axes (LSM6DS33_GYRO_X etc.) that updateAngle looks at, so only those need converting
+ * with lsm6ds33_convert
+ */
+unsigned int gestureAxes(const gesture_handler_t* reader);
 
 /**
  * The more frequently this is called, the more accurate it will be, generally.
- * If it is being called less frequently, you should change the KP constant in read_angle.c to something smaller
+ * The filters are tuned in time rather than samples, so any sample rate works
+ * @param time timer_get_ticks() when the sample was taken, which for samples from the FIFO is
+ *             earlier than when they are read
  */
-void updateAngle(gesture_handler_t* reader, const lsm6ds33_data_t* data);
+void updateAngle(gesture_handler_t* reader, const lsm6ds33_data_t* data, unsigned int time);
 
+/**
+ * Returns true once for each detected hit. reader->strikeVelocity then holds how hard it was.
+ * A hit is reported from the first sample after alpha crosses the threshold, and
+ * m_lastUpDownGestureTime holds that sample's time, so a hit is never held back
+ */
 bool checkUpDownGesture(gesture_handler_t* reader);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,42 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Polyphase FIR resampler for converting recordings to the output rate when
+ * they are loaded, so the mixer only ever plays samples at the rate it mixes
+ * at. The conversion ratio is reduced to up / down (160 / 147 for 44.1 kHz to
+ * 48 kHz), and each output frame is the dot product of RESAMPLE_TAPS input
+ * frames with one of 'up' phases of a Kaiser-windowed sinc. The filter passes
+ * everything below about 18 kHz (at 44.1 / 48 kHz) unchanged and cuts what
+ * the lower of the two rates can't hold by about 80 dB.
+ *
+ * Far too slow for the audio callback; meant for load time only.
+ */
+
+#define RESAMPLE_TAPS 64  // per phase
+#define RESAMPLE_STOPBAND_DB 80
+
+struct resampler
+{
+    unsigned int up, down;
+    int16_t *coeffs;  // Q15, 'up' phases of RESAMPLE_TAPS; NULL if the rates match
+};
+
+// Designs the filter for converting from 'in_rate' to 'out_rate'
+// Returns false if the filter table couldn't be allocated
+bool resample_init(struct resampler *r, unsigned int in_rate, unsigned int out_rate);
+void resample_free(struct resampler *r);
+
+// How many frames 'in_len' input frames turn into
+size_t resample_output_len(const struct resampler *r, size_t in_len);
+
+// Resamples the mono samples 'in' into 'out', which needs room for
+// resample_output_len(r, in_len) samples. Output frame m lines up with input
+// time m * down / up, so the result is not delayed
+void resample_run(const struct resampler *r, const int16_t *in, size_t in_len, int16_t *out);
+
+#endif
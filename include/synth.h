@@ -0,0 +1,79 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Glue between AMPi and the mixer. The chunk size sets the output latency: a
+ * hit can only be heard once the chunks already queued ahead of it have played,
+ * so smaller chunks respond faster but leave less slack before an underrun.
+ * Chunks are mixed ahead of time by synth_render into a ring (see pcm_ring.h),
+ * so the chunk callback itself only hands over what is already there.
+ */
+
+// Chunk sizes are in stereo frames; the mix buffers are sized for the largest
+#define SYNTH_MAX_CHUNK_FRAMES 800
+#ifndef SYNTH_CHUNK_FRAMES
+#define SYNTH_CHUNK_FRAMES 400
+#endif
+// With bulk transfers, chunks go to the VideoCore by DMA straight from the
+// buffer they were mixed into rather than being copied into VCHIQ messages
+#ifndef SYNTH_BULK_TRANSFER
+#define SYNTH_BULK_TRANSFER 0
+#endif
+// Timing of the chunk callback since the last synth_reset_timing
+// Times are in microseconds, queue depths in frames
+struct synth_timing
+{
+    unsigned int chunkFrames;
+    unsigned int callbacks;
+    unsigned int periodMin, periodAvg, periodMax;  // between successive callbacks
+    unsigned int jitter;     // largest distance of a period from the nominal chunk period
+    unsigned int queuedMin, queuedMax;  // left to play when a callback starts
+    unsigned int underruns;  // callbacks that found nothing left to play
+};
+
+// The AMPi chunk callback. Falls back to mixing the chunk itself (an underrun
+// of the ring) if the render step hasn't kept up
+unsigned synth(int16_t **buf, unsigned chunk_size);
+
+// The render step: mixes chunks into the ring until it is at its depth. Called
+// from the timer interrupt, just before AMPiPoke gives the callback its turn
+// Hits are placed by the time their chunk will be heard, from the audio clock
+// the callback keeps, so they all play the same latency after their timestamps
+void synth_render(void);
+
+// Initializes AMPi to play at 'sample_rate' with 'chunk_frames' frames per
+// chunk and hooks up synth, sending chunks the way SYNTH_BULK_TRANSFER asks for.
+// Recordings loaded afterwards are resampled to 'sample_rate'
+// Returns false if AMPi failed or 'sample_rate' or 'chunk_frames' is out of range
+bool synth_init(unsigned int sample_rate, unsigned int chunk_frames);
+
+// Switches to 'chunk_frames' per chunk from the next callback on; safe while
+// audio is running. Returns false if 'chunk_frames' is 0 or above
+// SYNTH_MAX_CHUNK_FRAMES
+bool synth_set_chunk_frames(unsigned int chunk_frames);
+unsigned int synth_get_chunk_frames(void);
+
+// Clears the timing counters at the start of the next callback
+void synth_reset_timing(void);
+void synth_get_timing(struct synth_timing *timing);
+
+// Measurement mode: plays each of the usual chunk sizes (128, 256, 512 and 800
+// frames) for 'ms_each' milliseconds and prints the timing seen with each,
+// then goes back to the chunk size it started with. Audio must be running
+void synth_measure_chunk_sizes(unsigned int ms_each);
+
+// Measurement mode: sends chunks as VCHIQ messages queued one by one, as
+// batched messages and as bulk transfers for 'ms_each' milliseconds each, and
+// prints the time, messages and doorbells it takes to hand a chunk over each
+// way. Audio must be running
+void synth_measure_submit_paths(unsigned int ms_each);
+
+// Prints what each of AMPi's driver threads is waiting for, how much time it
+// has run and the most of its stack it has used, to see what the scheduler
+// spends its time on and how small the stacks can be made
+void synth_print_thread_stats(void);
+
+#endif
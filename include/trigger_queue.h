@@ -0,0 +1,29 @@
+#ifndef TRIGGER_QUEUE_H
+#define TRIGGER_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Single-producer/single-consumer ring of trigger events. The main loop pushes
+ * events and the audio callback pops them at the start of each chunk. Neither
+ * side ever waits on the other, so it is safe to use from interrupt context.
+ */
+
+#define TRIGGER_QUEUE_LEN 32  // Must be a power of two
+
+struct trigger_event
+{
+    uint8_t seq_id;          // as returned by registerSequence
+    uint8_t pan;             // PAN_LEFT..PAN_RIGHT
+    int32_t gain;            // Q16.16
+    unsigned int timestamp;  // timer_get_ticks() when the hit was detected
+};
+
+// Returns false (and drops the event) if the queue is full
+bool trigger_push(const struct trigger_event *event);
+
+// Returns false if there is nothing to pop
+bool trigger_pop(struct trigger_event *event);
+
+#endif
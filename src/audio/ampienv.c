@@ -14,6 +14,7 @@
 #include "armtimer.h"
 #include "LSM6DS33.h"
 #include "config.h"
+#include "synth.h"
 
 void *ampi_malloc(size_t size)
 {
@@ -50,6 +51,11 @@ void usDelay(unsigned us)
 	timer_delay_us(us);
 }
 
+unsigned GetMicroseconds(void)
+{
+	return timer_get_ticks();
+}
+
 static TPeriodicTimerHandler *m_pHandlerTimer = NULL;
 
 static bool alarm(unsigned int pc)
@@ -58,6 +64,7 @@ static bool alarm(unsigned int pc)
 		return false;
 	if (m_pHandlerTimer != NULL)
 		m_pHandlerTimer();
+	synth_render();
 	AMPiPoke();
 	return true;
 }
@@ -110,6 +117,19 @@ uint32_t EnableVCHIQ(uint32_t buf)
 	return mboxbuf->tag.u32[0];
 }
 
+uint32_t GetCoreClockRate(void)
+{
+	typedef mbox_buf(8) proptag;
+	proptag *mboxbuf = (proptag *)0x4c80000;
+	mbox_init(*mboxbuf);
+	mboxbuf->tag.id = 0x30002; // get clock rate
+	mboxbuf->tag.u32[0] = 4;   // core clock
+	mboxbuf->tag.u32[1] = 0;
+	mailbox_write(MAILBOX_TAGS_ARM_TO_VC, (unsigned int)mboxbuf);
+	mailbox_read(MAILBOX_TAGS_ARM_TO_VC);
+	return mboxbuf->tag.u32[1];
+}
+
 void *GetCoherentRegion512K(void)
 {
 	return (void *)0x4c00000;
@@ -126,7 +146,7 @@ void env_init(void)
 	uart_init();
 
 
-	armtimer_init(10000); // 10 000 us = 100 Hz
+	armtimer_init(1000000 / AMPI_TICK_HZ);
 	armtimer_enable();
 	interrupts_register_handler(INTERRUPTS_BASIC_ARM_TIMER_IRQ, alarm);
 	armtimer_enable_interrupts();
@@ -1,7 +1,69 @@
 #include "audio_sequence.h"
+#include "mix.h"
+#include "resample.h"
+#include "trigger_queue.h"
+#include "malloc.h"
 #include "printf.h"
+#include "assert.h"
 
-struct audio_sequence all_tracks[NUM_TRACKS];
+struct track all_tracks[NUM_TRACK_SLOTS];
+static const struct audio_sequence *sequences[NUM_SEQUENCES];
+static size_t num_sequences;
+static volatile struct track_stats stats;
+static unsigned int outputRate = SAMPLE_RATE;
+
+// A recording resampled to the output rate by loadAudio
+struct sample_bank
+{
+    const int16_t *source;
+    size_t sourceLen;
+    unsigned int sourceRate, rate;
+    int16_t *samples;
+    size_t len;
+};
+static struct sample_bank banks[NUM_SAMPLE_BANKS];
+static size_t num_banks;
+// The filter is kept for the next recording at the same rates
+static struct resampler resampler;
+static unsigned int resamplerIn, resamplerOut;
+
+// Constant-power pan law: sqrt(2) * cos(pan / PAN_RIGHT * pi / 2) in Q16.16, so
+// that PAN_CENTER is unity gain on both sides. The right side reads it backwards
+static const int32_t pan_gains[PAN_RIGHT + 1] = {
+    92682, 92654, 92570, 92431, 92236, 91985, 91679, 91317,
+    90901, 90430, 89904, 89325, 88691, 88004, 87264, 86472,
+    85627, 84731, 83783, 82786, 81738, 80641, 79496, 78303,
+    77062, 75775, 74443, 73065, 71644, 70180, 68673, 67125,
+    65536, 63908, 62241, 60537, 58797, 57021, 55211, 53367,
+    51491, 49585, 47648, 45683, 43690, 41671, 39627, 37559,
+    35468, 33356, 31224, 29073, 26904, 24719, 22520, 20307,
+    18081, 15845, 13599, 11345, 9084, 6818, 4548, 2275,
+    0,
+};
+
+// Velocity curve in Q16.16: velocity 1 is -24 dB, rising linearly in dB to
+// unity gain at MAX_VELOCITY. Velocity 0 is silent
+static const int32_t velocity_gains[MAX_VELOCITY + 1] = {
+    0, 4135, 4227, 4320, 4416, 4514, 4614, 4717,
+    4821, 4928, 5037, 5149, 5263, 5380, 5499, 5621,
+    5746, 5873, 6003, 6136, 6272, 6411, 6554, 6699,
+    6847, 6999, 7154, 7313, 7475, 7641, 7810, 7984,
+    8161, 8341, 8526, 8715, 8909, 9106, 9308, 9514,
+    9725, 9941, 10161, 10387, 10617, 10852, 11093, 11339,
+    11590, 11847, 12110, 12379, 12653, 12934, 13220, 13513,
+    13813, 14119, 14432, 14752, 15079, 15414, 15756, 16105,
+    16462, 16827, 17200, 17581, 17971, 18370, 18777, 19193,
+    19619, 20054, 20498, 20953, 21417, 21892, 22378, 22874,
+    23381, 23899, 24429, 24971, 25524, 26090, 26669, 27260,
+    27865, 28482, 29114, 29759, 30419, 31094, 31783, 32488,
+    33208, 33944, 34697, 35466, 36252, 37056, 37878, 38718,
+    39576, 40454, 41350, 42267, 43204, 44162, 45141, 46142,
+    47165, 48211, 49280, 50373, 51489, 52631, 53798, 54991,
+    56210, 57456, 58730, 60032, 61363, 62724, 64114, 65536,
+};
+
+// Only every LEVEL_STRIDE-th sample is looked at when estimating a track's level
+#define LEVEL_STRIDE 16
 
 struct audio_file createAudio(int16_t *samples, size_t audio_len, float volume)
 {
@@ -10,64 +72,242 @@ struct audio_file createAudio(int16_t *samples, size_t audio_len, float volume)
     f.audio_samples = samples;
     f.audio_len = audio_len;
     f.volume = volume;
-    f.index = 0;
+    f.gain = (int32_t) (volume * AUDIO_GAIN_ONE + 0.5f);
     return f;
 }
 
-bool addTrack(struct audio_sequence* seq)
+static const struct sample_bank *findBank(const int16_t *samples, size_t audio_len, unsigned int sample_rate)
+{
+    for (size_t i = 0; i < num_banks; ++i) {
+        const struct sample_bank *bank = &banks[i];
+        if (bank->source == samples && bank->sourceLen == audio_len && bank->sourceRate == sample_rate &&
+            bank->rate == outputRate)
+            return bank;
+    }
+    return NULL;
+}
+
+static const struct sample_bank *resampleBank(const int16_t *samples, size_t audio_len, unsigned int sample_rate)
+{
+    if (num_banks == NUM_SAMPLE_BANKS) return NULL;
+    if (resamplerIn != sample_rate || resamplerOut != outputRate) {
+        resample_free(&resampler);
+        resamplerIn = resamplerOut = 0;
+        if (!resample_init(&resampler, sample_rate, outputRate)) return NULL;
+        resamplerIn = sample_rate;
+        resamplerOut = outputRate;
+    }
+    size_t len = resample_output_len(&resampler, audio_len);
+    int16_t *out = malloc(len * sizeof(int16_t));
+    if (out == NULL) return NULL;
+    resample_run(&resampler, samples, audio_len, out);
+
+    struct sample_bank *bank = &banks[num_banks++];
+    *bank = (struct sample_bank) { .source = samples, .sourceLen = audio_len, .sourceRate = sample_rate,
+                                   .rate = outputRate, .samples = out, .len = len };
+    return bank;
+}
+
+struct audio_file loadAudio(int16_t *samples, size_t audio_len, unsigned int sample_rate, float volume)
 {
-    for (size_t i = 0; i < NUM_TRACKS; ++i) {
+    if (samples == NULL || sample_rate == outputRate) return createAudio(samples, audio_len, volume);
+    const struct sample_bank *bank = findBank(samples, audio_len, sample_rate);
+    if (bank == NULL) bank = resampleBank(samples, audio_len, sample_rate);
+    // Played as it is, the recording would come out sharp and short
+    if (bank == NULL) printf("Couldn't resample %p from %d Hz to %d Hz\n", samples, sample_rate, outputRate);
+    assert(bank != NULL);
+    return createAudio(bank->samples, bank->len, volume);
+}
+
+void setOutputRate(unsigned int sample_rate)
+{
+    outputRate = sample_rate;
+}
+
+unsigned int getOutputRate(void)
+{
+    return outputRate;
+}
+
+int32_t velocityGain(unsigned int velocity)
+{
+    return velocity_gains[velocity > MAX_VELOCITY ? MAX_VELOCITY : velocity];
+}
+
+int registerSequence(const struct audio_sequence* seq)
+{
+    if (num_sequences == NUM_SEQUENCES) return -1;
+    sequences[num_sequences] = seq;
+    return num_sequences++;
+}
+
+bool triggerSequence(int seq_id, int32_t gain, uint8_t pan, unsigned int timestamp)
+{
+    if (seq_id < 0 || seq_id >= num_sequences) return false;
+    if (pan > PAN_RIGHT) pan = PAN_RIGHT;
+    struct trigger_event event = { .seq_id = seq_id, .pan = pan, .gain = gain, .timestamp = timestamp };
+    return trigger_push(&event);
+}
+
+void getTrackStats(struct track_stats *out)
+{
+    out->started = stats.started;
+    out->stolen = stats.stolen;
+    out->dropped = stats.dropped;
+}
+
+// Picks the track to fade out when all NUM_TRACKS are busy
+static struct track *stealVictim(void)
+{
+    struct track *victim = NULL;
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) {
+        struct track *t = &all_tracks[i];
+        if (!t->isRunning || t->isReleasing) continue;
+#if TRACK_STEAL_POLICY == TRACK_STEAL_OLDEST
+        if (victim == NULL || t->age > victim->age) victim = t;
+#else
+        if (victim == NULL || t->level < victim->level
+            || (t->level == victim->level && t->age > victim->age)) victim = t;
+#endif
+    }
+    return victim;
+}
+
+// Only called from the audio callback, so the tracks can't change under us
+static bool addTrack(const struct audio_sequence* seq, int32_t gain, uint8_t pan, size_t delay)
+{
+    struct track *slot = NULL;
+    size_t active = 0;
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) {
         if (!all_tracks[i].isRunning) {
-            seq->isRunning = false;  // Make sure that we don't do anything thread-unsafe; the track won't play until after the copy
-            all_tracks[i] = *seq;    // Copy onto all_tracks[i]
-            all_tracks[i].isRunning = true;
-            return true;
+            if (slot == NULL) slot = &all_tracks[i];
+        } else if (!all_tracks[i].isReleasing) {
+            active++;
+        }
+    }
+    // Out of polyphony, or every spare slot is still fading something out
+    if (slot == NULL || active == NUM_TRACKS) {
+        struct track *victim = stealVictim();
+        if (victim != NULL && victim->delay > 0) {
+            // Nothing of it has been heard yet, so there is nothing to fade
+            victim->isRunning = false;
+            if (slot == NULL) slot = victim;
+        } else if (slot == NULL || victim == NULL) {
+            stats.dropped++;
+            return false;
+        } else {
+            victim->isReleasing = true;
+            victim->release = TRACK_RELEASE_FRAMES;
         }
+        stats.stolen++;
     }
-    return false;
+    slot->seq = seq;
+    slot->index = 0;
+    slot->position = 0;
+    slot->delay = delay;
+    slot->gainL = (int32_t) (((int64_t) gain * pan_gains[pan]) >> AUDIO_GAIN_SHIFT);
+    slot->gainR = (int32_t) (((int64_t) gain * pan_gains[PAN_RIGHT - pan]) >> AUDIO_GAIN_SHIFT);
+    slot->age = 0;
+    slot->level = INT32_MAX;  // a new hit is loud until it has been heard
+    slot->isReleasing = false;
+    slot->isRunning = true;
+    stats.started++;
+    return true;
 }
 
-static int16_t clamp(int32_t sample) {
-    if (sample > INT16_MAX) return INT16_MAX;
-    else if (sample < INT16_MIN) return INT16_MIN;
-    else return (int16_t) sample;
+static int32_t spanLevel(const int16_t *samples, size_t frames, int32_t gain)
+{
+    int32_t peak = 0;
+    for (size_t i = 0; i < frames; i += LEVEL_STRIDE) {
+        int32_t s = samples[i] < 0 ? -samples[i] : samples[i];
+        if (s > peak) peak = s;
+    }
+    return (int32_t) (((int64_t) peak * gain) >> AUDIO_GAIN_SHIFT);
 }
 
-bool dumpMusic(struct audio_sequence* seq, int16_t *buf, size_t buflen)
+bool dumpMusic(struct track* track, int32_t *bus, size_t frames)
 {
-    for (size_t i = 0; i < buflen; i += 2) {
-        if (seq->index < seq->len) {
-            struct audio_file* aud = &seq->audios[seq->index];
-            if (aud->audio_samples != NULL) {
-                int32_t sample = (int32_t)buf[i] + aud->audio_samples[aud->index] * aud->volume;
-                buf[i] = buf[i+1] = clamp(sample);
-            }
-            if (++aud->index == aud->audio_len) {
-                seq->index++;
-            }
-        } else return true;
+    const struct audio_sequence *seq = track->seq;
+    int32_t level = 0;
+    if (track->delay > 0) {
+        size_t skip = track->delay < frames ? track->delay : frames;
+        bus += 2 * skip;
+        frames -= skip;
+        track->delay -= skip;
+    }
+    track->age += frames;
+    while (frames > 0 && track->index < seq->len) {
+        const struct audio_file* aud = &seq->audios[track->index];
+        size_t span = aud->audio_len - track->position;
+        if (span > frames) span = frames;
+        int32_t gainL = (int32_t) (((int64_t) aud->gain * track->gainL) >> AUDIO_GAIN_SHIFT);
+        int32_t gainR = (int32_t) (((int64_t) aud->gain * track->gainR) >> AUDIO_GAIN_SHIFT);
+        if (track->isReleasing) {
+            // Fade out in small constant-gain steps
+            if (track->release == 0) break;
+            if (span > TRACK_RELEASE_STEP) span = TRACK_RELEASE_STEP;
+            gainL = gainL * (int32_t) track->release / TRACK_RELEASE_FRAMES;
+            gainR = gainR * (int32_t) track->release / TRACK_RELEASE_FRAMES;
+            track->release -= span < track->release ? span : track->release;
+        }
+        // Silence entries have no samples; skipping over them is just index math
+        if (aud->audio_samples != NULL) {
+            const int16_t *samples = &aud->audio_samples[track->position];
+            mix_accumulate(bus, samples, span, gainL, gainR);
+            int32_t spanPeak = spanLevel(samples, span, gainL > gainR ? gainL : gainR);
+            if (spanPeak > level) level = spanPeak;
+        }
+        bus += 2 * span;
+        frames -= span;
+        track->position += span;
+        if (track->position == aud->audio_len) {
+            track->index++;
+            track->position = 0;
+        }
     }
-    return seq->index >= seq->len;
+    track->level = level;
+    return track->index >= seq->len || (track->isReleasing && track->release == 0);
 }
 
-void dumpAllTracks(int16_t *buf, size_t buflen)
+// Maps a trigger timestamp onto the frame it plays at, counted from the start
+// of the chunk being rendered. A hit that lands past the end of the chunk
+// waits out the rest in the track's delay, so it is never moved earlier
+static size_t triggerOffset(unsigned int timestamp, unsigned int start)
 {
-    for (size_t i = 0; i < buflen; ++i) buf[i] = 0;
-    for (size_t i = 0; i < NUM_TRACKS; ++i) {
-        if (all_tracks[i].isRunning && dumpMusic(&all_tracks[i], buf, buflen)) {
+    int32_t elapsed = (int32_t) (timestamp - start);
+    if (elapsed <= 0) return 0;  // too late for its frame, so play it at once
+    size_t offset = (size_t) (((uint64_t) elapsed * outputRate) / 1000000);
+    // Anything further ahead than a second is a stray timestamp
+    return offset < outputRate ? offset : 0;
+}
+
+void dumpAllTracks(int16_t *buf, int32_t *bus, size_t buflen, unsigned int start)
+{
+    size_t frames = buflen / 2;
+    struct trigger_event event;
+    while (trigger_pop(&event)) {
+        addTrack(sequences[event.seq_id], event.gain, event.pan, triggerOffset(event.timestamp, start));
+    }
+
+    for (size_t i = 0; i < buflen; ++i) bus[i] = 0;
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) {
+        if (all_tracks[i].isRunning && dumpMusic(&all_tracks[i], bus, frames)) {
             all_tracks[i].isRunning = false;
         }
     }
+    mix_write(buf, bus, frames);
 }
 
 void debugTracks(void)
 {
     printf("\n\n\n");
-    for (size_t i = 0; i < NUM_TRACKS; ++i) {
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) {
         if (all_tracks[i].isRunning) {
-            printf("Track %d: index=%d len=%d audios[0]=%p", i, all_tracks[i].index, all_tracks[i].len, all_tracks[i].audios[0].audio_samples);
+            printf("Track %d: index=%d len=%d audios[0]=%p age=%d level=%d%s", i, all_tracks[i].index, all_tracks[i].seq->len,
+                   all_tracks[i].seq->audios[0].audio_samples, all_tracks[i].age, all_tracks[i].level,
+                   all_tracks[i].isReleasing ? " (releasing)" : "");
             printf("\n");
         }
     }
+    printf("Tracks started=%d stolen=%d dropped=%d\n", stats.started, stats.stolen, stats.dropped);
 }
-
@@ -0,0 +1,36 @@
+#include "instrument.h"
+
+void initInstrument(struct instrument *inst)
+{
+    for (size_t v = 0; v <= MAX_VELOCITY; ++v) inst->layerOfVelocity[v] = 0;
+    inst->numLayers = 0;
+}
+
+bool addInstrumentSample(struct instrument *inst, unsigned int min_velocity, int seq_id)
+{
+    if (seq_id < 0 || min_velocity > MAX_VELOCITY) return false;
+    size_t layer = inst->numLayers - 1;
+    if (inst->numLayers == 0 || min_velocity > inst->minVelocity[layer]) {
+        if (inst->numLayers == INSTRUMENT_MAX_LAYERS) return false;
+        layer = inst->numLayers++;
+        inst->minVelocity[layer] = min_velocity;
+        inst->numAlternatives[layer] = 0;
+        inst->nextAlternative[layer] = 0;
+        for (size_t v = min_velocity; v <= MAX_VELOCITY; ++v) inst->layerOfVelocity[v] = layer;
+    } else if (min_velocity < inst->minVelocity[layer]) {
+        return false;
+    }
+    if (inst->numAlternatives[layer] == INSTRUMENT_MAX_ALTERNATIVES) return false;
+    inst->seqIds[layer][inst->numAlternatives[layer]++] = seq_id;
+    return true;
+}
+
+bool triggerInstrument(struct instrument *inst, unsigned int velocity, uint8_t pan, unsigned int timestamp)
+{
+    if (inst->numLayers == 0) return false;
+    if (velocity > MAX_VELOCITY) velocity = MAX_VELOCITY;
+    size_t layer = inst->layerOfVelocity[velocity];
+    size_t alt = inst->nextAlternative[layer];
+    inst->nextAlternative[layer] = alt + 1 == inst->numAlternatives[layer] ? 0 : alt + 1;
+    return triggerSequence(inst->seqIds[layer][alt], velocityGain(velocity), pan, timestamp);
+}
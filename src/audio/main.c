@@ -8,20 +8,71 @@
 #include "gpioextra.h"
 #include "printf.h"
 #include "audio_sequence.h"
+#include "synth.h"
+#include "instrument.h"
 #include "timer.h"
 #include "read_angle.h"
 #include "gl.h"
 #include "config.h"
 
-// Implemented in synth.c
-unsigned synth(int16_t **buf, unsigned chunk_size);
-
 // INIT_AUDIO(hello_world);
 INIT_AUDIO(hihat);
 INIT_AUDIO(snare);
 INIT_AUDIO(crash);
 INIT_AUDIO(kick);
 
+// Where each drum sits in the stereo field, as seen from the drummer's seat
+static const uint8_t HIHAT_PAN = PAN_LEFT + 16;
+static const uint8_t SNARE_PAN = PAN_CENTER - 6;
+static const uint8_t KICK_PAN = PAN_CENTER;
+static const uint8_t CRASH_PAN = PAN_RIGHT - 18;
+
+// Both sticks sample at SENSOR_RATE into their FIFOs, whose watermark
+// interrupts on INT1 tell the main loop when to drain them, SENSOR_BATCH
+// samples at a time. The first of two samples at 833 Hz is read about 2 ms
+// after it was taken: 1.2 ms until the second one, 0.8 ms to read both.
+// Bus budget at 400 kHz: a drain is about 100 + 108 * SENSOR_WATERMARK bit
+// times (310 for 2), and the two sticks drain 833 times a second between them,
+// about 260 kbit/s or 65% of the bus. The I2C driver polls, so the main loop is
+// busy reading for that share too. A watermark of 4 brings it to 55% (the
+// samples alone are 45%) for 2.4 ms more latency
+#define SENSOR_RATE LSM6DS33_RATE_833_HZ
+#define SENSOR_BATCH 32
+#define SENSOR_WATERMARK 2
+#ifndef SENSOR0_INT1_PIN
+#define SENSOR0_INT1_PIN GPIO_PIN23
+#endif
+#ifndef SENSOR1_INT1_PIN
+#define SENSOR1_INT1_PIN GPIO_PIN24
+#endif
+
+static lsm6ds33_dev_t sensor0, sensor1;
+
+static void startSensor(lsm6ds33_dev_t *dev, unsigned int int1_pin) {
+	lsm6ds33_attach_int1(dev, int1_pin);
+	lsm6ds33_route_int1(dev, LSM6DS33_INT1_FTH);
+	lsm6ds33_enable_fifo(dev, SENSOR_RATE, SENSOR_WATERMARK);
+}
+
+// Feeds the samples waiting in a sensor's FIFO to 'reader', if its INT1 says
+// there are any, stamping each a period after the one before it
+static void readSensor(lsm6ds33_dev_t *dev, gesture_handler_t *reader) {
+	static lsm6ds33_raw_t raw[SENSOR_BATCH];
+	static lsm6ds33_data_t samples[SENSOR_BATCH];
+	unsigned int time;
+	if (!lsm6ds33_take_int1_event(dev, &time)) return;
+
+	unsigned int period = lsm6ds33_sample_period_us(SENSOR_RATE);
+	unsigned int axes = gestureAxes(reader);
+	unsigned int n;
+	do {
+		// Only the two accel axes and one gyro axis the reader uses get scaled
+		n = lsm6ds33_read_fifo_raw(dev, raw, SENSOR_BATCH);
+		lsm6ds33_convert(dev, raw, n, axes, samples);
+		for (unsigned int i = 0; i < n; ++i, time += period) updateAngle(reader, &samples[i], time);
+	} while (n == SENSOR_BATCH);
+}
+
 static unsigned int snprintf_angle(double angle, char* buf, size_t buflen, unsigned int precision) {
 	char temp[16];
 	size_t i = 0;
@@ -47,8 +98,7 @@ void main (void)
 	// Initialize audio
 	DSB();
 	// linuxemu_EnterCritical();  // I don't know if this is necessary
-	AMPiInitialize(SAMPLE_RATE, 800);
-	AMPiSetChunkCallback(synth);
+	synth_init(SAMPLE_RATE, SYNTH_CHUNK_FRAMES);
 	// linuxemu_LeaveCritical();
 	DMB();
 
@@ -60,23 +110,30 @@ void main (void)
 #endif
 	timer_delay(1);
 	printf("AMPi ready!\n");
+#if defined(MEASURE_CHUNK_TIMING) && !defined(DEBUG_NO_AUDIO)
+	synth_measure_chunk_sizes(2000);
+	synth_measure_submit_paths(2000);
+	synth_print_thread_stats();
+#endif
 
 
-    // lsm6ds33_init(LSM6DS33_I2CADDR_DEFAULT, LSM6DS33_RATE_104_HZ);
-    lsm6ds33_init_dual(LSM6DS33_I2CADDR_DEFAULT, LSM6DS33_I2CADDR_ALTERNATE, LSM6DS33_RATE_208_HZ);
+    lsm6ds33_init(&sensor0, LSM6DS33_I2CADDR_DEFAULT, SENSOR_RATE);
+    lsm6ds33_init(&sensor1, LSM6DS33_I2CADDR_ALTERNATE, SENSOR_RATE);
 	printf("Finished initializing sensor\n");
-    gesture_handler_t reader0 = createGestureReader(CONFIG_HORIZ, CONFIG_VERT);
-	gesture_handler_t reader1 = createGestureReader(CONFIG_HORIZ, CONFIG_VERT);
-    lsm6ds33_set_active_sensor(LSM6DS33_SENSOR0);
+    gesture_handler_t reader0 = createGestureReader(CONFIG_HORIZ, CONFIG_VERT, lsm6ds33_sample_period_us(SENSOR_RATE));
+	gesture_handler_t reader1 = createGestureReader(CONFIG_HORIZ, CONFIG_VERT, lsm6ds33_sample_period_us(SENSOR_RATE));
 
 #ifdef SHOULD_SENSOR_CALIBRATE
-	calibrate(&reader0);
-	lsm6ds33_set_active_sensor(LSM6DS33_SENSOR1);
-	calibrate(&reader1);
-    lsm6ds33_set_active_sensor(LSM6DS33_SENSOR0);	
+	calibrate(&reader0, &sensor0);
+	calibrate(&reader1, &sensor1);
 	printf("Done calibrating\n");
 #endif
 
+	// Only start collecting samples now, so the FIFOs don't start out full of
+	// ones taken while calibrating
+	startSensor(&sensor0, SENSOR0_INT1_PIN);
+	startSensor(&sensor1, SENSOR1_INT1_PIN);
+
 
 	// setup buttons
 	gpio_set_input(BUTTON0_PIN);
@@ -84,30 +141,44 @@ void main (void)
 	gpio_set_pullup(BUTTON0_PIN);
 	gpio_set_pullup(BUTTON1_PIN);
 
+	// Each drum is an instrument whose layers and round-robin alternatives are
+	// registered sequences. There is one recording per drum so far, so each has a
+	// single layer; softer/harder takes go in with addInstrumentSample as
+	// another layer at the velocity they should start from
+	struct instrument hihat, snare, kick, crash;
+
 	struct audio_sequence hello_world_hihat;  // no hello world, too large, just followed by hihat
-	hello_world_hihat.index = 0;
 	hello_world_hihat.len = 0;
 	hello_world_hihat.audios[hello_world_hihat.len++] = MAKE_AUDIO(hihat, 5.0);
-	addTrack(&hello_world_hihat);
+	int hihat_id = registerSequence(&hello_world_hihat);
+	initInstrument(&hihat);
+	addInstrumentSample(&hihat, 1, hihat_id);
+	triggerSequence(hihat_id, AUDIO_GAIN_ONE, HIHAT_PAN, timer_get_ticks());
 
 	struct audio_sequence snare_only;
-	snare_only.index = snare_only.len = 0;
+	snare_only.len = 0;
 	snare_only.audios[snare_only.len++] = MAKE_AUDIO(snare, 1.0);
+	initInstrument(&snare);
+	addInstrumentSample(&snare, 1, registerSequence(&snare_only));
 
 	// struct audio_sequence hihat_snare;
-	// hihat_snare.index = hihat_snare.len = 0;
+	// hihat_snare.len = 0;
 	// hihat_snare.audios[hihat_snare.len++] = MAKE_AUDIO(hihat, 3.0);
 	// hihat_snare.audios[hihat_snare.len++] = MAKE_SILENCE(0.5);
 	// hihat_snare.audios[hihat_snare.len++] = MAKE_AUDIO(hihat, 5.0);
 	// hihat_snare.audios[hihat_snare.len++] = MAKE_AUDIO(snare, 1);
 
 	struct audio_sequence kick_drum;
-	kick_drum.index = kick_drum.len = 0;
+	kick_drum.len = 0;
 	kick_drum.audios[kick_drum.len++] = MAKE_AUDIO(kick, 1.0);
+	initInstrument(&kick);
+	addInstrumentSample(&kick, 1, registerSequence(&kick_drum));
 
 	struct audio_sequence crash_cymbal;
-	crash_cymbal.index = crash_cymbal.len = 0;
+	crash_cymbal.len = 0;
 	crash_cymbal.audios[crash_cymbal.len++] = MAKE_AUDIO(crash, 3.0);
+	initInstrument(&crash);
+	addInstrumentSample(&crash, 1, registerSequence(&crash_cymbal));
 
 #ifdef DEBUG_NO_AUDIO
 	printf("Initializing graphics\n");
@@ -124,15 +195,8 @@ void main (void)
 
 	printf("Done\n\n");  // So that the angle doesn't overwrite anything
 	while (1) {
-		lsm6ds33_data_t data;
-
-        lsm6ds33_set_active_sensor(LSM6DS33_SENSOR0);
-        lsm6ds33_get_all(&data);
-		updateAngle(&reader0, &data);
-
-        lsm6ds33_set_active_sensor(LSM6DS33_SENSOR1);
-        lsm6ds33_get_all(&data);
-		updateAngle(&reader1, &data);
+		readSensor(&sensor0, &reader0);
+		readSensor(&sensor1, &reader1);
 
 		unsigned int time = timer_get_ticks();
 		if (time - printTime > 10000) {
@@ -157,7 +221,11 @@ void main (void)
 		}
         
 		if (checkUpDownGesture(&reader0)) {
-			addTrack((gpio_read(BUTTON0_PIN) ? &snare_only : &kick_drum)); // snare drum if not pressed, kick if pressed
+			// snare drum if not pressed, kick if pressed
+			// Stamped with when the sample that showed the hit was taken
+			unsigned int hitTime = reader0.m_lastUpDownGestureTime;
+			if (gpio_read(BUTTON0_PIN)) triggerInstrument(&snare, reader0.strikeVelocity, SNARE_PAN, hitTime);
+			else triggerInstrument(&kick, reader0.strikeVelocity, KICK_PAN, hitTime);
 			// Random color hack
 #ifdef DEBUG_NO_AUDIO
 			gl_draw_rect(0, 0, 20, 20, ((time * 0xcf25801d) ^ time) | 0xff000000);
@@ -165,7 +233,10 @@ void main (void)
 		}
 
 		if (checkUpDownGesture(&reader1)) {
-			addTrack((gpio_read(BUTTON1_PIN) ? &hello_world_hihat : &crash_cymbal)); // hihat if not pressed, crash cymbal if pressed
+			// hihat if not pressed, crash cymbal if pressed
+			unsigned int hitTime = reader1.m_lastUpDownGestureTime;
+			if (gpio_read(BUTTON1_PIN)) triggerInstrument(&hihat, reader1.strikeVelocity, HIHAT_PAN, hitTime);
+			else triggerInstrument(&crash, reader1.strikeVelocity, CRASH_PAN, hitTime);
 			// Random color hack
 #ifdef DEBUG_NO_AUDIO
 			gl_draw_rect(0, 20, 20, 20, ((time * 0xcf25801d) ^ time) | 0xff000000);
@@ -0,0 +1,134 @@
+#include "mix.h"
+#include "audio_sequence.h"
+
+// One interleaved stereo frame (or two mono samples) as a single word
+typedef uint32_t __attribute__((may_alias)) mix_word_t;
+
+static int16_t clamp(int32_t sample) {
+    if (sample > INT16_MAX) return INT16_MAX;
+    else if (sample < INT16_MIN) return INT16_MIN;
+    else return (int16_t) sample;
+}
+
+// Half an output step on the bus, added before the fraction bits are dropped
+#define MIX_ROUND (1 << (MIX_FRAC_BITS - 1))
+
+// sample * gain with MIX_FRAC_BITS left below the output LSB, for a 'gain'
+// already shifted up by MIX_FRAC_BITS. This is the product smlawb/smlawt give
+// in the ARMv6 kernel; how the compiler builds it here is up to the compiler
+static inline int32_t scale(int16_t sample, int32_t gain) {
+    return (int32_t) (((int64_t) sample * gain) >> AUDIO_GAIN_SHIFT);
+}
+
+void mix_accumulate_c(int32_t *bus, const int16_t *samples, size_t frames, int32_t gainL, int32_t gainR)
+{
+    gainL <<= MIX_FRAC_BITS;
+    gainR <<= MIX_FRAC_BITS;
+    for (size_t i = 0; i < frames; ++i) {
+        bus[2*i] += scale(samples[i], gainL);
+        bus[2*i+1] += scale(samples[i], gainR);
+    }
+}
+
+void mix_write_c(int16_t *buf, const int32_t *bus, size_t frames)
+{
+    for (size_t i = 0; i < 2 * frames; ++i) {
+        buf[i] = clamp((bus[i] + MIX_ROUND) >> MIX_FRAC_BITS);
+    }
+}
+
+#ifdef MIX_ARMV6
+
+// acc + ((a * bottom half of b) >> 16)
+static inline int32_t smlawb(int32_t a, uint32_t b, int32_t acc) {
+    int32_t result;
+    __asm__ ("smlawb %0, %1, %2, %3" : "=r" (result) : "r" (a), "r" (b), "r" (acc));
+    return result;
+}
+
+// acc + ((a * top half of b) >> 16)
+static inline int32_t smlawt(int32_t a, uint32_t b, int32_t acc) {
+    int32_t result;
+    __asm__ ("smlawt %0, %1, %2, %3" : "=r" (result) : "r" (a), "r" (b), "r" (acc));
+    return result;
+}
+
+// x >> MIX_FRAC_BITS, saturated to int16
+static inline int32_t ssat16(int32_t x) {
+    int32_t result;
+    __asm__ ("ssat %0, #16, %1, asr %2" : "=r" (result) : "r" (x), "I" (MIX_FRAC_BITS));
+    return result;
+}
+
+// Bottom half of lo, bottom half of hi in the top half
+static inline uint32_t pkhbt(int32_t lo, int32_t hi) {
+    uint32_t result;
+    __asm__ ("pkhbt %0, %1, %2, lsl #16" : "=r" (result) : "r" (lo), "r" (hi));
+    return result;
+}
+
+#else
+
+// C equivalents of the instructions above, so the ARMv6 kernel can be checked
+// against the reference on the host
+
+static inline int32_t smlawb(int32_t a, uint32_t b, int32_t acc) {
+    return acc + (int32_t) (((int64_t) a * (int16_t) b) >> 16);
+}
+
+static inline int32_t smlawt(int32_t a, uint32_t b, int32_t acc) {
+    return acc + (int32_t) (((int64_t) a * (int16_t) (b >> 16)) >> 16);
+}
+
+static inline int32_t ssat16(int32_t x) {
+    return clamp(x >> MIX_FRAC_BITS);
+}
+
+static inline uint32_t pkhbt(int32_t lo, int32_t hi) {
+    return ((uint32_t) lo & 0xffff) | ((uint32_t) hi << 16);
+}
+
+#endif
+
+void mix_accumulate_armv6(int32_t *bus, const int16_t *samples, size_t frames, int32_t gainL, int32_t gainR)
+{
+    gainL <<= MIX_FRAC_BITS;
+    gainR <<= MIX_FRAC_BITS;
+    // Get the input onto a word boundary so samples can be loaded in pairs
+    if (frames > 0 && ((uintptr_t) samples & 2)) {
+        uint32_t sample = (uint16_t) *samples++;
+        bus[0] = smlawb(gainL, sample, bus[0]);
+        bus[1] = smlawb(gainR, sample, bus[1]);
+        bus += 2;
+        frames--;
+    }
+    // One load feeds four multiply-accumulates
+    const mix_word_t *in = (const mix_word_t *) samples;
+    for (; frames >= 2; frames -= 2) {
+        uint32_t pair = *in++;
+        bus[0] = smlawb(gainL, pair, bus[0]);
+        bus[1] = smlawb(gainR, pair, bus[1]);
+        bus[2] = smlawt(gainL, pair, bus[2]);
+        bus[3] = smlawt(gainR, pair, bus[3]);
+        bus += 4;
+    }
+    if (frames > 0) {
+        uint32_t sample = *(const uint16_t *) in;
+        bus[0] = smlawb(gainL, sample, bus[0]);
+        bus[1] = smlawb(gainR, sample, bus[1]);
+    }
+}
+
+void mix_write_armv6(int16_t *buf, const int32_t *bus, size_t frames)
+{
+    mix_word_t *out = (mix_word_t *) buf;
+    for (; frames >= 2; frames -= 2) {
+        out[0] = pkhbt(ssat16(bus[0] + MIX_ROUND), ssat16(bus[1] + MIX_ROUND));
+        out[1] = pkhbt(ssat16(bus[2] + MIX_ROUND), ssat16(bus[3] + MIX_ROUND));
+        out += 2;
+        bus += 4;
+    }
+    if (frames > 0) {
+        *out = pkhbt(ssat16(bus[0] + MIX_ROUND), ssat16(bus[1] + MIX_ROUND));
+    }
+}
@@ -0,0 +1,77 @@
+#include "pcm_ring.h"
+
+// Cache-line aligned so a bulk transfer never shares a line with anything else
+static int16_t chunks[PCM_RING_SLOTS][PCM_RING_CHUNK_LEN] __attribute__((aligned(32)));
+static size_t lengths[PCM_RING_SLOTS];
+// Free-running counters; only the producer writes head and only the consumer writes tail
+static unsigned int head, tail;
+static volatile unsigned int depth = PCM_RING_DEPTH;
+// Each counter is written by one side only
+static volatile unsigned int minFill = PCM_RING_MAX_DEPTH, rendered, underruns, fullTicks;
+
+bool pcm_ring_set_depth(unsigned int chunks)
+{
+    if (chunks == 0 || chunks > PCM_RING_MAX_DEPTH) return false;
+    depth = chunks;
+    return true;
+}
+
+unsigned int pcm_ring_get_depth(void)
+{
+    return depth;
+}
+
+unsigned int pcm_ring_space(void)
+{
+    unsigned int fill = head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    return fill < depth ? depth - fill : 0;
+}
+
+int16_t *pcm_ring_write_slot(void)
+{
+    return chunks[head % PCM_RING_SLOTS];
+}
+
+void pcm_ring_commit(size_t len)
+{
+    lengths[head % PCM_RING_SLOTS] = len;
+    rendered++;
+    // Publish the chunk before the consumer can see the new head
+    __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+}
+
+void pcm_ring_count_full_tick(void)
+{
+    fullTicks++;
+}
+
+const int16_t *pcm_ring_read(size_t *len)
+{
+    unsigned int t = tail;
+    unsigned int fill = __atomic_load_n(&head, __ATOMIC_ACQUIRE) - t;
+    if (fill < minFill) minFill = fill;
+    if (fill == 0) {
+        underruns++;
+        return NULL;
+    }
+    *len = lengths[t % PCM_RING_SLOTS];
+    // The producer can only reuse the slot after the second read from now
+    __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+    return chunks[t % PCM_RING_SLOTS];
+}
+
+void pcm_ring_get_stats(struct pcm_ring_stats *stats)
+{
+    stats->depth = depth;
+    stats->fill = __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    stats->minFill = minFill;
+    stats->rendered = rendered;
+    stats->underruns = underruns;
+    stats->fullTicks = fullTicks;
+}
+
+void pcm_ring_reset_stats(void)
+{
+    minFill = PCM_RING_MAX_DEPTH;
+    rendered = underruns = fullTicks = 0;
+}
@@ -0,0 +1,121 @@
+#include <math.h>
+#include "resample.h"
+#include "malloc.h"
+
+#define KAISER_BETA (0.1102 * (RESAMPLE_STOPBAND_DB - 8.7))
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+    while (b != 0) {
+        unsigned int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Zeroth-order modified Bessel function of the first kind, for the Kaiser window
+static double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50 && term > sum * 1e-12; ++k) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+bool resample_init(struct resampler *r, unsigned int in_rate, unsigned int out_rate)
+{
+    unsigned int g = gcd(in_rate, out_rate);
+    r->up = out_rate / g;
+    r->down = in_rate / g;
+    r->coeffs = NULL;
+    if (r->up == r->down) return true;
+
+    size_t len = (size_t) r->up * RESAMPLE_TAPS;
+    r->coeffs = malloc(len * sizeof(int16_t));
+    if (r->coeffs == NULL) return false;
+
+    // The prototype lowpass runs at in_rate * up. Its transition band is as
+    // wide as the taps allow, and ends at the lower rate's Nyquist frequency
+    double upRate = (double) in_rate * r->up;
+    double minRate = in_rate < out_rate ? in_rate : out_rate;
+    double transition = (RESAMPLE_STOPBAND_DB - 7.95) / (14.36 * RESAMPLE_TAPS) * in_rate;
+    double cutoff = (minRate / 2 - transition / 2) / upRate;  // cycles per sample
+    double center = len / 2.0;
+    double windowNorm = besselI0(KAISER_BETA);
+
+    for (unsigned int phase = 0; phase < r->up; ++phase) {
+        // Tap j of a phase multiplies the j-th oldest of the frames it covers,
+        // so the table is stored back to front for the inner loop to run forwards
+        int16_t *taps = &r->coeffs[phase * RESAMPLE_TAPS];
+        double h[RESAMPLE_TAPS], sum = 0;
+        for (unsigned int j = 0; j < RESAMPLE_TAPS; ++j) {
+            double t = phase + (double) j * r->up - center;
+            double sinc = t == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+            double x = t / center;
+            double window = x * x < 1 ? besselI0(KAISER_BETA * sqrt(1 - x * x)) / windowNorm : 0;
+            h[j] = r->up * sinc * window;
+            sum += h[j];
+        }
+        // Normalize every phase to exactly unity gain at DC, so a constant
+        // input doesn't pick up a ripple at the phase rate
+        int32_t total = 0, peak = 0;
+        for (unsigned int j = 0; j < RESAMPLE_TAPS; ++j) {
+            taps[RESAMPLE_TAPS - 1 - j] = (int16_t) lrint(h[j] / sum * 32768);
+            total += taps[RESAMPLE_TAPS - 1 - j];
+            if (taps[RESAMPLE_TAPS - 1 - j] > taps[peak]) peak = RESAMPLE_TAPS - 1 - j;
+        }
+        taps[peak] += 32768 - total;
+    }
+    return true;
+}
+
+void resample_free(struct resampler *r)
+{
+    free(r->coeffs);
+    r->coeffs = NULL;
+}
+
+size_t resample_output_len(const struct resampler *r, size_t in_len)
+{
+    return (size_t) (((uint64_t) in_len * r->up + r->down - 1) / r->down);
+}
+
+static int16_t saturate(int64_t acc)
+{
+    acc = (acc + (1 << 14)) >> 15;
+    if (acc > INT16_MAX) return INT16_MAX;
+    if (acc < INT16_MIN) return INT16_MIN;
+    return (int16_t) acc;
+}
+
+void resample_run(const struct resampler *r, const int16_t *in, size_t in_len, int16_t *out)
+{
+    size_t out_len = resample_output_len(r, in_len);
+    if (r->coeffs == NULL) {
+        for (size_t m = 0; m < out_len; ++m) out[m] = in[m];
+        return;
+    }
+
+    // Output frame m sits at m * down in the upsampled stream; the filter's
+    // centre is half its length behind the newest frame it covers
+    uint64_t pos = (uint64_t) r->up * RESAMPLE_TAPS / 2;
+    for (size_t m = 0; m < out_len; ++m, pos += r->down) {
+        const int16_t *taps = &r->coeffs[(pos % r->up) * RESAMPLE_TAPS];
+        int64_t first = (int64_t) (pos / r->up) - (RESAMPLE_TAPS - 1);
+        int64_t acc = 0;
+        if (first >= 0 && first + RESAMPLE_TAPS <= (int64_t) in_len) {
+            const int16_t *x = &in[first];
+            for (unsigned int j = 0; j < RESAMPLE_TAPS; ++j) acc += (int32_t) x[j] * taps[j];
+        } else {
+            // Near either end, where the input is taken to be silent
+            for (unsigned int j = 0; j < RESAMPLE_TAPS; ++j) {
+                int64_t i = first + j;
+                if (i >= 0 && i < (int64_t) in_len) acc += (int32_t) in[i] * taps[j];
+            }
+        }
+        out[m] = saturate(acc);
+    }
+}
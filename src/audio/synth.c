@@ -1,13 +1,241 @@
 #include <stdint.h>
+#include <ampi.h>
+#include <linux/synchronize.h>
 #include "audio_sequence.h"
+#include "synth.h"
+#include "pcm_ring.h"
 #include "printf.h"
+#include "timer.h"
 
+static unsigned int chunkFrames = SYNTH_CHUNK_FRAMES;
+
+// Only the callback writes these; resetTiming asks it to start over
+static struct synth_timing timing;
+static unsigned int periodTotal, periods;
+static unsigned int lastCallback;
+static volatile bool resetTiming = true;
+
+// Audio clock: output frame clockFrame starts playing at clockTime. Each
+// callback sets it from what AMPi still has queued, with interrupts off so the
+// render step never sees half of it
+static unsigned int clockFrame, clockTime;
+static bool clockSet;
+static unsigned int handedFrames, renderedFrames;
+// Every trigger plays this long after its timestamp: the longest a trigger has
+// waited from one render step until the chunk the next step rendered is heard.
+// It only depends on the chunk size and the buffering, so it settles at once
+static unsigned int triggerLatency;
+static unsigned int lastRenderTime;
+static bool latencyMeasured;
+static volatile bool resetLatency;
+
+static unsigned int framesToMicros(unsigned int frames)
+{
+	return (unsigned int) ((uint64_t) frames * 1000000 / getOutputRate());
+}
+
+static void recordCallback(unsigned int frames, unsigned int now, unsigned int queued)
+{
+	if (resetTiming) {
+		timing = (struct synth_timing) { .periodMin = UINT32_MAX, .queuedMin = UINT32_MAX };
+		periodTotal = periods = 0;
+		resetTiming = false;
+	} else {
+		unsigned int period = now - lastCallback;
+		unsigned int nominal = frames * 1000000u / getOutputRate();
+		unsigned int deviation = period > nominal ? period - nominal : nominal - period;
+		if (period < timing.periodMin) timing.periodMin = period;
+		if (period > timing.periodMax) timing.periodMax = period;
+		if (deviation > timing.jitter) timing.jitter = deviation;
+		periodTotal += period;
+		periods++;
+	}
+	lastCallback = now;
+	timing.chunkFrames = frames;
+	timing.callbacks++;
+	if (queued < timing.queuedMin) timing.queuedMin = queued;
+	if (queued > timing.queuedMax) timing.queuedMax = queued;
+	if (queued == 0) timing.underruns++;
+}
+
+// Mixes chunks until the ring is at its depth. Each chunk is stamped with when
+// it will be heard by the audio clock, less triggerLatency, so a hit is placed
+// by its timestamp rather than by when the render step happened to run
+static void renderChunks(void)
+{
+	static int32_t bus[2 * SYNTH_MAX_CHUNK_FRAMES];  // interleaved stereo mix bus
+	unsigned int n = pcm_ring_space();
+	if (n == 0) return;
+	unsigned int now = timer_get_ticks();
+	if (resetLatency) {
+		triggerLatency = 0;
+		latencyMeasured = false;
+		resetLatency = false;
+	}
+	// Until audio starts there is no clock, so chunks are taken to start now
+	unsigned int base = clockSet ? clockTime : now;
+	unsigned int baseFrame = clockSet ? clockFrame : renderedFrames;
+	for (unsigned int i = 0; i < n; ++i) {
+		size_t len = 2 * chunkFrames;
+		unsigned int start = base + framesToMicros(renderedFrames - baseFrame);
+		// Only the first chunk takes triggers, which are all from after the last step
+		if (i == 0 && latencyMeasured && start - lastRenderTime > triggerLatency)
+			triggerLatency = start - lastRenderTime;
+		dumpAllTracks(pcm_ring_write_slot(), bus, len, start - triggerLatency);
+		pcm_ring_commit(len);
+		renderedFrames += chunkFrames;
+	}
+	lastRenderTime = now;
+	// Waits from before audio started say nothing about the buffering
+	latencyMeasured = clockSet;
+}
+
+void synth_render(void)
+{
+	if (pcm_ring_space() == 0) pcm_ring_count_full_tick();
+	else renderChunks();
+}
 
 unsigned synth(int16_t **o_buf, unsigned chunk_size)
 {
-	static int16_t buf[8192];
-	*o_buf = &buf[0];
+	unsigned int now = timer_get_ticks();
+	unsigned int queued = AMPiGetQueuedBytes() / (2 * sizeof(int16_t));
+	recordCallback(chunk_size / 2, now, queued);
+	// The chunk handed over now is heard once what is queued has played
+	linuxemu_EnterCritical();
+	clockTime = now + framesToMicros(queued);
+	clockFrame = handedFrames;
+	clockSet = true;
+	linuxemu_LeaveCritical();
+
+	size_t len;
+	const int16_t *buf = pcm_ring_read(&len);
+	if (buf == NULL) {
+		// The render step runs from the timer interrupt, which mustn't render
+		// at the same time
+		linuxemu_EnterCritical();
+		renderChunks();
+		linuxemu_LeaveCritical();
+		buf = pcm_ring_read(&len);
+	}
+	handedFrames += len / 2;
+	// A chunk rendered before a change of chunk size keeps its old length
+	*o_buf = (int16_t *) buf;
+	return len;
+}
+
+bool synth_init(unsigned int sample_rate, unsigned int chunk_frames)
+{
+	if (chunk_frames == 0 || chunk_frames > SYNTH_MAX_CHUNK_FRAMES) return false;
+	chunkFrames = chunk_frames;
+	if (!AMPiInitialize(sample_rate, 2 * chunk_frames)) return false;
+	setOutputRate(sample_rate);
+	AMPiSetChunkCallback(synth);
+	AMPiSetBulkTransfer(SYNTH_BULK_TRANSFER);
+	return true;
+}
+
+bool synth_set_chunk_frames(unsigned int chunk_frames)
+{
+	if (chunk_frames == 0 || chunk_frames > SYNTH_MAX_CHUNK_FRAMES) return false;
+	chunkFrames = chunk_frames;
+	resetLatency = true;
+	AMPiSetChunkSize(2 * chunk_frames);
+	return true;
+}
+
+unsigned int synth_get_chunk_frames(void)
+{
+	return chunkFrames;
+}
+
+void synth_reset_timing(void)
+{
+	resetTiming = true;
+}
+
+void synth_get_timing(struct synth_timing *out)
+{
+	linuxemu_EnterCritical();
+	*out = timing;
+	out->periodAvg = periods ? periodTotal / periods : 0;
+	if (periods == 0) out->periodMin = 0;
+	if (out->callbacks == 0) out->queuedMin = 0;
+	linuxemu_LeaveCritical();
+}
+
+void synth_measure_chunk_sizes(unsigned int ms_each)
+{
+	static const unsigned int sizes[] = {128, 256, 512, 800};
+	unsigned int original = synth_get_chunk_frames();
+
+	printf("frames  nominal   callbacks  period min/avg/max  jitter  queued min/max  underruns  ring min/underruns  callback max  late\n");
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		synth_set_chunk_frames(sizes[i]);
+		// Let the chunks queued at the old size play out before measuring
+		timer_delay_ms(50);
+		synth_reset_timing();
+		pcm_ring_reset_stats();
+		AMPiResetStats();
+		timer_delay_ms(ms_each);
+
+		struct synth_timing t;
+		struct pcm_ring_stats r;
+		AMPiStats a;
+		synth_get_timing(&t);
+		pcm_ring_get_stats(&r);
+		AMPiGetStats(&a);
+		printf("%6d  %5dus  %10d  %5d/%5d/%5dus  %5dus  %6d/%6d  %9d  %8d/%9d  %10dus  %4d\n", t.chunkFrames,
+		       t.chunkFrames * 1000000 / getOutputRate(), t.callbacks, t.periodMin, t.periodAvg,
+		       t.periodMax, t.jitter, t.queuedMin, t.queuedMax, t.underruns, r.minFill, r.underruns,
+		       a.nCallbackMaxMicros, a.nLateCompletions);
+	}
+	synth_set_chunk_frames(original);
+}
+
+// Prints 'total / chunks' with two decimals, as printf has no floats
+static void printPerChunk(unsigned int total, unsigned int chunks)
+{
+	unsigned int hundredths = chunks != 0 ? total * 100 / chunks : 0;
+	printf("  %4d.%02d", hundredths / 100, hundredths % 100);
+}
+
+void synth_measure_submit_paths(unsigned int ms_each)
+{
+	static const char *names[] = {"messages", "batched", "bulk"};
+	static const AMPiSubmitPath paths[] = {AMPiSubmitMessages, AMPiSubmitBatchedMessages, AMPiSubmitBulk};
+
+	printf("Submitting %d-frame chunks\n", synth_get_chunk_frames());
+	printf("path        us/chunk  msgs/chunk  bells/chunk\n");
+	for (unsigned int i = 0; i < 3; i++) {
+		AMPiSubmitStats before, after;
+
+		AMPiGetSubmitStats(paths[i], &before);
+		AMPiSetBatchedMessages(paths[i] == AMPiSubmitBatchedMessages);
+		AMPiSetBulkTransfer(paths[i] == AMPiSubmitBulk);
+		timer_delay_ms(ms_each);
+		AMPiGetSubmitStats(paths[i], &after);
+
+		unsigned int chunks = after.nChunks - before.nChunks;
+		printf("%-10s", names[i]);
+		printPerChunk(after.nMicros - before.nMicros, chunks);
+		printf("   ");
+		printPerChunk(after.nMessages - before.nMessages, chunks);
+		printf("    ");
+		printPerChunk(after.nDoorbells - before.nDoorbells, chunks);
+		printf("\n");
+	}
+	AMPiSetBatchedMessages(true);
+	AMPiSetBulkTransfer(SYNTH_BULK_TRANSFER);
+}
+
+void synth_print_thread_stats(void)
+{
+	AMPiThreadStats stats;
 
-	dumpAllTracks(buf, chunk_size);
-	return chunk_size;
+	printf("thread  state       switches  run (us)  max run (us)  stack used\n");
+	for (unsigned int thread = 1; AMPiGetThreadStats(thread, &stats); thread++)
+		printf("%6d  %-10s  %8d  %8d  %12d  %5d/%5d\n", thread, stats.pState,
+		       stats.nSwitches, stats.nRunMicros, stats.nMaxRunMicros,
+		       stats.nStackUsedBytes, stats.nStackBytes);
 }
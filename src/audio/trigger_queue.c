@@ -0,0 +1,24 @@
+#include "trigger_queue.h"
+
+static struct trigger_event events[TRIGGER_QUEUE_LEN];
+// Free-running counters; only the producer writes head and only the consumer writes tail
+static unsigned int head, tail;
+
+bool trigger_push(const struct trigger_event *event)
+{
+    unsigned int h = head;
+    if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == TRIGGER_QUEUE_LEN) return false;
+    events[h % TRIGGER_QUEUE_LEN] = *event;
+    // Publish the event before the consumer can see the new head
+    __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool trigger_pop(struct trigger_event *event)
+{
+    unsigned int t = tail;
+    if (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == t) return false;
+    *event = events[t % TRIGGER_QUEUE_LEN];
+    __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+    return true;
+}
@@ -1,8 +1,12 @@
 #include "LSM6DS33.h"
 #include "i2c.h"
+#include "gpio.h"
+#include "gpioextra.h"
+#include "interrupts.h"
 #include "assert.h"
 #include "printf.h"
 #include "timer.h"
+#include "common.h"
 
 /*
  * Module to interact with the LSM6DS33 6DOF IMU over I2C. This is designed for use 
@@ -13,84 +17,76 @@
  * Date:   June 2020
  */
 
-static int dual_sensors;
-static int addresses[2];
-static lsm6ds33_sensor_id_t active_sensor;
-static double accel_multiplier;
-static double gyro_multiplier;
 static const double grav_accel = 9.80665;
+// Whole FIFO, so one burst can drain it into lsm6ds33_read_fifo
+static lsm6ds33_raw_t fifo_samples[LSM6DS33_FIFO_MAX_SAMPLES];
+// Sensors whose INT1 the GPIO interrupt handler looks after
+static lsm6ds33_dev_t *int1_devices[LSM6DS33_MAX_INT1_DEVICES];
+static unsigned int num_int1_devices;
 
-void lsm6ds33_init(int addr, lsm6ds33_data_rate_t rate) {
+// Clock divider of BSC1, the I2C controller on GPIO 2 and 3, which divides the core clock
+#define BSC1_DIV ((volatile unsigned int *) 0x20804014)
+// The core clock when the firmware can't say, as set by default on the Pi 1 and Zero
+#define DEFAULT_CORE_CLOCK_HZ 250000000
+
+// The bus is shared by all the sensors, so it is only set up for the first one.
+// The i2c module (libpi) has no way to set the bus speed, so the divider is set
+// here once it has initialized BSC1. It is worked out from the core clock as
+// it is now, which holds as long as the core clock isn't scaled afterwards
+// (the default unless config.txt turns on dynamic core_freq)
+static void start_i2c(void) {
+    static bool started;
+    if (started) return;
     i2c_init();
-    dual_sensors = 0;
-    addresses[0] = addr;
-    addresses[1] = 0;
-    active_sensor = LSM6DS33_SENSOR0;
-    
+    unsigned int core_clock = GetCoreClockRate();
+    if (core_clock == 0) core_clock = DEFAULT_CORE_CLOCK_HZ;
+    // BSC rounds the divider down to an even number, so it is rounded up to
+    // one here and the bus never runs faster than asked for
+    unsigned int divider = (core_clock + LSM6DS33_I2C_HZ - 1) / LSM6DS33_I2C_HZ;
+    *BSC1_DIV = (divider + 1) & ~1u;
+    started = true;
+}
+
+static void detach_int1(lsm6ds33_dev_t *dev);
+
+void lsm6ds33_init(lsm6ds33_dev_t *dev, int addr, lsm6ds33_data_rate_t rate) {
+    start_i2c();
+    // The handler must not be left holding a device that is being started over
+    detach_int1(dev);
+    *dev = (lsm6ds33_dev_t) { .addr = addr };
+
     // confirm sensor is connected
-    char whoami = lsm6ds33_read_register(LSM6DS33_WHOAMI);    
+    char whoami = lsm6ds33_read_register(dev, LSM6DS33_WHOAMI);
     int sensor_connected = (whoami == 0x69);  // this register always contains 0x69
     assert(sensor_connected); // give it a nice name so that it makes sense if it fails
-    lsm6ds33_write_register(LSM6DS33_CTRL9_XL, 0b00111000); // enable accel XYZ axes
-    lsm6ds33_write_register(LSM6DS33_CTRL10_C, 0b00111000); // enable gyro XYZ axes
-    lsm6ds33_set_accel_data_rate(rate);
-    lsm6ds33_set_gyro_data_rate(rate);
-    lsm6ds33_set_accel_range(LSM6DS33_ACCEL_RANGE_4G);
-    lsm6ds33_set_gyro_range(LSM6DS33_GYRO_RANGE_250_DPS);
-}
 
-void lsm6ds33_init_dual(int addr0, int addr1, lsm6ds33_data_rate_t rate) {
-    i2c_init();
-    dual_sensors = 1;
-    addresses[0] = addr0;
-    addresses[1] = addr1;
-
-    // confirm sensor0 is connected
-    lsm6ds33_set_active_sensor(LSM6DS33_SENSOR0);
-    char whoami = lsm6ds33_read_register(LSM6DS33_WHOAMI);
-    int sensor0_connected = (whoami == 0x69);  // this register always contains 0x69
-    assert(sensor0_connected); // give it a nice name so that it makes sense if it fails
-    lsm6ds33_write_register(LSM6DS33_CTRL9_XL, 0b00111000); // enable accel XYZ axes
-    lsm6ds33_write_register(LSM6DS33_CTRL10_C, 0b00111000); // enable gyro XYZ axes
-    lsm6ds33_set_accel_data_rate(rate);
-    lsm6ds33_set_gyro_data_rate(rate);
-    lsm6ds33_set_accel_range(LSM6DS33_ACCEL_RANGE_4G);
-    lsm6ds33_set_gyro_range(LSM6DS33_GYRO_RANGE_250_DPS);
-
-    // confirm sensor1 is connected
-    lsm6ds33_set_active_sensor(LSM6DS33_SENSOR1);    
-    whoami = lsm6ds33_read_register(LSM6DS33_WHOAMI);
-    int sensor1_connected = (whoami == 0x69);  // this register always contains 0x69
-    assert(sensor1_connected); // give it a nice name so that it makes sense if it fails
-    lsm6ds33_write_register(LSM6DS33_CTRL9_XL, 0b00111000); // enable accel XYZ axes
-    lsm6ds33_write_register(LSM6DS33_CTRL10_C, 0b00111000); // enable gyro XYZ axes
-    lsm6ds33_set_accel_data_rate(rate);
-    lsm6ds33_set_gyro_data_rate(rate);
-    lsm6ds33_set_accel_range(LSM6DS33_ACCEL_RANGE_4G);
-    lsm6ds33_set_gyro_range(LSM6DS33_GYRO_RANGE_250_DPS);
-}
-
-void lsm6ds33_set_active_sensor(lsm6ds33_sensor_id_t id) {
-    if (dual_sensors) { // change active_sensor if in dual sensor mode
-        active_sensor = id;
-    }
+    // Block data update stops the output registers changing between the bytes
+    // of a burst read of them, and bursts need the address to auto-increment
+    lsm6ds33_write_register(dev, LSM6DS33_CTRL3_C, LSM6DS33_CTRL3_BDU | LSM6DS33_CTRL3_IF_INC);
+    lsm6ds33_write_register(dev, LSM6DS33_CTRL9_XL, 0b00111000); // enable accel XYZ axes
+    lsm6ds33_write_register(dev, LSM6DS33_CTRL10_C, 0b00111000); // enable gyro XYZ axes
+    lsm6ds33_set_accel_data_rate(dev, rate);
+    lsm6ds33_set_gyro_data_rate(dev, rate);
+    lsm6ds33_set_accel_range(dev, LSM6DS33_ACCEL_RANGE_4G);
+    lsm6ds33_set_gyro_range(dev, LSM6DS33_GYRO_RANGE_250_DPS);
 }
 
-unsigned int lsm6ds33_set_accel_data_rate(lsm6ds33_data_rate_t rate) {
-    char data = lsm6ds33_read_register(LSM6DS33_CTRL1_XL);
+unsigned int lsm6ds33_set_accel_data_rate(lsm6ds33_dev_t *dev, lsm6ds33_data_rate_t rate) {
+    char data = lsm6ds33_read_register(dev, LSM6DS33_CTRL1_XL);
     data &= 0b00001111; // clear first four bits (data rate)
     data |= (rate << 4); // set the first four bits (data rate) according to requested rate 
-    return lsm6ds33_write_register(LSM6DS33_CTRL1_XL, data);
+    return lsm6ds33_write_register(dev, LSM6DS33_CTRL1_XL, data);
 }
 
-unsigned int lsm6ds33_set_gyro_data_rate(lsm6ds33_data_rate_t rate) {
-    char data = lsm6ds33_read_register(LSM6DS33_CTRL2_G);
+unsigned int lsm6ds33_set_gyro_data_rate(lsm6ds33_dev_t *dev, lsm6ds33_data_rate_t rate) {
+    char data = lsm6ds33_read_register(dev, LSM6DS33_CTRL2_G);
     data &= 0b00001111; // clear first four bits (data rate)
     data |= (rate << 4); // set the first four bits (data rate) according to requested rate 
-    return lsm6ds33_write_register(LSM6DS33_CTRL2_G, data);
+    return lsm6ds33_write_register(dev, LSM6DS33_CTRL2_G, data);
 }
 
-unsigned int lsm6ds33_set_accel_range(lsm6ds33_accel_range_t range) {  
+unsigned int lsm6ds33_set_accel_range(lsm6ds33_dev_t *dev, lsm6ds33_accel_range_t range) {
+    double accel_multiplier = 0;
     switch (range) {
         case LSM6DS33_ACCEL_RANGE_16G:
             accel_multiplier = 0.0488; // 16000 millig / (10*2^15)
@@ -105,13 +101,16 @@ unsigned int lsm6ds33_set_accel_range(lsm6ds33_accel_range_t range) {
             accel_multiplier = 0.0061; //  2000 millig / (10*2^15)
             break;
     }
-    char data = lsm6ds33_read_register(LSM6DS33_CTRL1_XL);
+    dev->accel_range = range;
+    dev->accel_scale = accel_multiplier * grav_accel;
+    char data = lsm6ds33_read_register(dev, LSM6DS33_CTRL1_XL);
     data &= 0b11110011; // clear two bits (data range)
     data |= (range << 2); // set the two bits (data range) according to requested range 
-    return lsm6ds33_write_register(LSM6DS33_CTRL1_XL, data);
+    return lsm6ds33_write_register(dev, LSM6DS33_CTRL1_XL, data);
 }
 
-unsigned int lsm6ds33_set_gyro_range(lsm6ds33_gyro_range_t range) {
+unsigned int lsm6ds33_set_gyro_range(lsm6ds33_dev_t *dev, lsm6ds33_gyro_range_t range) {
+    double gyro_multiplier = 0;
     switch (range) {
         case LSM6DS33_GYRO_RANGE_2000_DPS:
             gyro_multiplier = 70.0;
@@ -129,60 +128,233 @@ unsigned int lsm6ds33_set_gyro_range(lsm6ds33_gyro_range_t range) {
             gyro_multiplier = 4.375;
             break;
     }
-    char data = lsm6ds33_read_register(LSM6DS33_CTRL2_G);
+    dev->gyro_range = range;
+    dev->gyro_scale = gyro_multiplier / 1000;
+    char data = lsm6ds33_read_register(dev, LSM6DS33_CTRL2_G);
     data &= 0b11110000; // clear last four bits (data range)
     data |= range; // set last four bits (data range) according to requested range 
-    return lsm6ds33_write_register(LSM6DS33_CTRL2_G, data);
+    return lsm6ds33_write_register(dev, LSM6DS33_CTRL2_G, data);
+}
+
+// Reads 'len' consecutive registers starting at 'reg' in one transaction
+static void read_registers(lsm6ds33_dev_t *dev, char reg, void *buf, int len) {
+    i2c_write(dev->addr, &reg, 1);
+    i2c_read(dev->addr, buf, len);
+}
+
+// The raw readings are read straight into lsm6ds33_raw_t, as the sensor and
+// the ARM are both little endian
+void lsm6ds33_get_all_raw(lsm6ds33_dev_t *dev, lsm6ds33_raw_t *raw) {
+    read_registers(dev, LSM6DS33_OUTX_L_G, raw, sizeof(*raw));
+}
+
+void lsm6ds33_get_all(lsm6ds33_dev_t *dev, lsm6ds33_data_t *data) {
+    lsm6ds33_raw_t raw;
+    lsm6ds33_get_all_raw(dev, &raw);
+    lsm6ds33_convert(dev, &raw, 1, LSM6DS33_ALL_AXES, data);
+}
+
+// One pass per requested axis, so axes nobody asked for cost nothing
+#define CONVERT_AXIS(bit, field, reading, scale) \
+    if (axes & (bit)) { \
+        for (unsigned int i = 0; i < count; i++) data[i].field = raw[i].reading * (scale); \
+    }
+
+void lsm6ds33_convert(const lsm6ds33_dev_t *dev, const lsm6ds33_raw_t *raw, unsigned int count,
+                      unsigned int axes, lsm6ds33_data_t *data) {
+    float gyro_scale = dev->gyro_scale, accel_scale = dev->accel_scale;
+    CONVERT_AXIS(LSM6DS33_GYRO_X, gyrox, gyro[0], gyro_scale);
+    CONVERT_AXIS(LSM6DS33_GYRO_Y, gyroy, gyro[1], gyro_scale);
+    CONVERT_AXIS(LSM6DS33_GYRO_Z, gyroz, gyro[2], gyro_scale);
+    CONVERT_AXIS(LSM6DS33_ACCEL_X, accelx, accel[0], accel_scale);
+    CONVERT_AXIS(LSM6DS33_ACCEL_Y, accely, accel[1], accel_scale);
+    CONVERT_AXIS(LSM6DS33_ACCEL_Z, accelz, accel[2], accel_scale);
+}
+
+unsigned int lsm6ds33_enable_fifo(lsm6ds33_dev_t *dev, lsm6ds33_data_rate_t rate, unsigned int watermark) {
+    unsigned int words = watermark * LSM6DS33_FIFO_SAMPLE_WORDS;
+    if (words == 0 || words >= LSM6DS33_FIFO_WORDS) return 0;
+
+    // Bursts from the FIFO need IF_INC, which lsm6ds33_init sets
+    unsigned int ok = lsm6ds33_write_register(dev, LSM6DS33_FIFO_CTRL5, 0); // bypass mode empties the FIFO
+    ok &= lsm6ds33_write_register(dev, LSM6DS33_FIFO_CTRL1, words & 0xff);
+    ok &= lsm6ds33_write_register(dev, LSM6DS33_FIFO_CTRL2, (words >> 8) & 0x0f);
+    ok &= lsm6ds33_write_register(dev, LSM6DS33_FIFO_CTRL3, 0b00001001); // gyro and accel, no decimation
+    ok &= lsm6ds33_write_register(dev, LSM6DS33_FIFO_CTRL4, 0); // no third data set
+    ok &= lsm6ds33_write_register(dev, LSM6DS33_FIFO_CTRL5, (rate << 3) | 0b110); // continuous mode
+    dev->fifo_discard = true;
+    dev->fifo_status_cached = false;
+    dev->fifo_watermark = watermark;
+    dev->fifo_period_us = lsm6ds33_sample_period_us(rate);
+    return ok;
+}
+
+unsigned int lsm6ds33_disable_fifo(lsm6ds33_dev_t *dev) {
+    dev->fifo_watermark = 0;
+    dev->fifo_status_cached = false;
+    return lsm6ds33_write_register(dev, LSM6DS33_FIFO_CTRL5, 0);
 }
 
-void lsm6ds33_get_all(lsm6ds33_data_t *data) {
-    char buf[12];
-    char reg = LSM6DS33_OUTX_L_G;
-    i2c_write(addresses[active_sensor], &reg, 1);
-    i2c_read(addresses[active_sensor], buf, 12);
+// Whole samples a read of the FIFO would return, given its FIFO_STATUS1..4.
+// '*skip' gets the words to drop before them
+static unsigned int fifo_samples_waiting(const lsm6ds33_dev_t *dev, const unsigned char *status, unsigned int *skip) {
+    unsigned int unread = (status[1] & 0x0f) << 8 | status[0];
+    unsigned int pattern = (status[3] & 0x03) << 8 | status[2];
 
-    short gyrox = buf[1] << 8 | buf[0];
-    short gyroy = buf[3] << 8 | buf[2];
-    short gyroz = buf[5] << 8 | buf[4];
-    short accelx = buf[7] << 8 | buf[6];
-    short accely = buf[9] << 8 | buf[8];
-    short accelz = buf[11] << 8 | buf[10];
+    // After an overrun the next word can be partway through a sample. The words
+    // up to the next gyro X (and a sample to discard) are dropped
+    *skip = pattern == 0 ? 0 : LSM6DS33_FIFO_SAMPLE_WORDS - pattern;
+    if (dev->fifo_discard) *skip += LSM6DS33_FIFO_SAMPLE_WORDS;
+    if (unread < *skip) return 0;
+    return (unread - *skip) / LSM6DS33_FIFO_SAMPLE_WORDS;
+}
+
+unsigned int lsm6ds33_read_fifo_raw(lsm6ds33_dev_t *dev, lsm6ds33_raw_t *samples, unsigned int max_samples) {
+    // lsm6ds33_take_int1_event may have just read the status to stamp these
+    // samples. Reading only what it saw keeps the stamps right and saves a transaction
+    unsigned char *status = dev->fifo_status;
+    if (dev->fifo_status_cached) dev->fifo_status_cached = false;
+    else read_registers(dev, LSM6DS33_FIFO_STATUS1, status, 4);
+    if (status[1] & LSM6DS33_FIFO_OVERRUN) dev->fifo_overruns++;
+    unsigned int skip;
+    unsigned int count = fifo_samples_waiting(dev, status, &skip);
+    if (count > max_samples) count = max_samples;
+    if (count == 0) return 0;
+
+    // The address rolls back from FIFO_DATA_OUT_H to FIFO_DATA_OUT_L, so one
+    // read of any length pops that many words. Dropping words is rare, so they
+    // get a read of their own and the samples can go straight into place
+    if (skip > 0) {
+        short dropped[2 * LSM6DS33_FIFO_SAMPLE_WORDS];
+        read_registers(dev, LSM6DS33_FIFO_DATA_OUT_L, dropped, 2 * skip);
+        dev->fifo_discard = false;
+    }
+    read_registers(dev, LSM6DS33_FIFO_DATA_OUT_L, samples, count * sizeof(lsm6ds33_raw_t));
+    return count;
+}
+
+unsigned int lsm6ds33_read_fifo(lsm6ds33_dev_t *dev, lsm6ds33_data_t *samples, unsigned int max_samples) {
+    if (max_samples > LSM6DS33_FIFO_MAX_SAMPLES) max_samples = LSM6DS33_FIFO_MAX_SAMPLES;
+    unsigned int count = lsm6ds33_read_fifo_raw(dev, fifo_samples, max_samples);
+    lsm6ds33_convert(dev, fifo_samples, count, LSM6DS33_ALL_AXES, samples);
+    return count;
+}
+
+unsigned int lsm6ds33_route_int1(lsm6ds33_dev_t *dev, char events) {
+    return lsm6ds33_write_register(dev, LSM6DS33_INT1_CTRL, events);
+}
 
-    data->gyrox = gyrox * gyro_multiplier / 1000;
-    data->gyroy = gyroy * gyro_multiplier / 1000;
-    data->gyroz = gyroz * gyro_multiplier / 1000;
+static bool handle_int1(unsigned int pc) {
+    unsigned int now = timer_get_ticks();
+    bool handled = false;
+    for (unsigned int i = 0; i < num_int1_devices; i++) {
+        lsm6ds33_dev_t *dev = int1_devices[i];
+        if (gpio_check_and_clear_event(dev->int1_pin)) {
+            dev->int1_time = now;
+            dev->int1_pending = true;
+            handled = true;
+        }
+    }
+    return handled;
+}
 
-    data->accelx = accelx * accel_multiplier * grav_accel;
-    data->accely = accely * accel_multiplier * grav_accel;
-    data->accelz = accelz * accel_multiplier * grav_accel;
+// Takes 'dev' out of the handler's list if it is there. Only the pointer is
+// compared, so 'dev' may hold anything if it isn't
+static void detach_int1(lsm6ds33_dev_t *dev) {
+    for (unsigned int i = 0; i < num_int1_devices; i++) {
+        if (int1_devices[i] != dev) continue;
+        gpio_disable_event_detection(dev->int1_pin, GPIO_DETECT_RISING_EDGE);
+        // The last device fills the gap before the count drops, so the handler
+        // sees every other device throughout (the moved one maybe twice)
+        int1_devices[i] = int1_devices[num_int1_devices - 1];
+        __atomic_store_n(&num_int1_devices, num_int1_devices - 1, __ATOMIC_RELEASE);
+        dev->int1_attached = false;
+        return;
+    }
 }
 
-unsigned int lsm6ds33_get_accel_single_axis(lsm6ds33_axis_t axis) {
+unsigned int lsm6ds33_attach_int1(lsm6ds33_dev_t *dev, unsigned int pin) {
+    static bool handler_registered;
+    detach_int1(dev);
+    if (num_int1_devices == LSM6DS33_MAX_INT1_DEVICES) return 0;
+    if (!handler_registered) {
+        interrupts_register_handler(INTERRUPTS_GPIO3, handle_int1);
+        interrupts_enable_source(INTERRUPTS_GPIO3);
+        handler_registered = true;
+    }
+
+    gpio_set_input(pin);
+    dev->int1_pin = pin;
+    dev->int1_pending = false;
+    dev->int1_attached = true;
+    // The handler can run at any point, so it only sees the device once it is
+    // filled in, and edges are only detected once it is there to clear them
+    int1_devices[num_int1_devices] = dev;
+    __atomic_store_n(&num_int1_devices, num_int1_devices + 1, __ATOMIC_RELEASE);
+    gpio_enable_event_detection(pin, GPIO_DETECT_RISING_EDGE);
+    return 1;
+}
+
+bool lsm6ds33_take_int1_event(lsm6ds33_dev_t *dev, unsigned int *time) {
+    if (!dev->int1_attached) return false;
+    // Cleared before the time is read, so an edge in between is seen next call
+    if (dev->int1_pending) {
+        dev->int1_pending = false;
+        *time = dev->int1_time;
+        // The edge came as the watermark'th sample landed in the drained FIFO
+        if (dev->fifo_watermark > 0) *time -= (dev->fifo_watermark - 1) * dev->fifo_period_us;
+        return true;
+    }
+    // A pin that never went low makes no new edge. The newest sample waiting
+    // has only just arrived, so the oldest is a period back for each of the others
+    if (gpio_read(dev->int1_pin)) {
+        *time = timer_get_ticks();
+        if (dev->fifo_watermark > 0) {
+            // Kept for the read of the FIFO that follows
+            unsigned int skip;
+            read_registers(dev, LSM6DS33_FIFO_STATUS1, dev->fifo_status, 4);
+            dev->fifo_status_cached = true;
+            unsigned int waiting = fifo_samples_waiting(dev, dev->fifo_status, &skip);
+            if (waiting > 0) *time -= (waiting - 1) * dev->fifo_period_us;
+        }
+        return true;
+    }
+    return false;
+}
+
+unsigned int lsm6ds33_sample_period_us(lsm6ds33_data_rate_t rate) {
+    static const unsigned int periods[] = {
+        0, 80000, 38462, 19231, 9615, 4808, 2404, 1200, 602, 300, 150
+    };
+    return rate < sizeof(periods) / sizeof(periods[0]) ? periods[rate] : 0;
+}
+
+unsigned int lsm6ds33_get_accel_single_axis(lsm6ds33_dev_t *dev, lsm6ds33_axis_t axis) {
     char reg_l = LSM6DS33_OUTX_L_XL + 2*axis;
     char reg_h = reg_l + 1;
-    int data = lsm6ds33_read_register(reg_l);
-    data |= lsm6ds33_read_register(reg_h) << 8;
+    int data = lsm6ds33_read_register(dev, reg_l);
+    data |= lsm6ds33_read_register(dev, reg_h) << 8;
     return data;
 }
 
-unsigned int lsm6ds33_get_gyro_single_axis(lsm6ds33_axis_t axis) {
+unsigned int lsm6ds33_get_gyro_single_axis(lsm6ds33_dev_t *dev, lsm6ds33_axis_t axis) {
     char reg_l = LSM6DS33_OUTX_L_G + 2*axis; // X axis offset 0, Y axis offset 2, Z axis offset 4
     char reg_h = reg_l + 1;
-    int data = lsm6ds33_read_register(reg_l);
-    data |= lsm6ds33_read_register(reg_h) << 8;
+    int data = lsm6ds33_read_register(dev, reg_l);
+    data |= lsm6ds33_read_register(dev, reg_h) << 8;
     return data; 
 }
 
-char lsm6ds33_read_register(char reg) {
+char lsm6ds33_read_register(lsm6ds33_dev_t *dev, char reg) {
     char result = 0;
-    i2c_write(addresses[active_sensor], &reg, 1);
-    i2c_read(addresses[active_sensor], &result, 1);
+    i2c_write(dev->addr, &reg, 1);
+    i2c_read(dev->addr, &result, 1);
     return result;
 }
 
-unsigned int lsm6ds33_write_register(char reg, char data) {
+unsigned int lsm6ds33_write_register(lsm6ds33_dev_t *dev, char reg, char data) {
     char towrite[2] = {reg, data};
-    i2c_write(addresses[active_sensor], towrite, 2);
-    char result = lsm6ds33_read_register(reg); // confirm that it was successfully written
+    i2c_write(dev->addr, towrite, 2);
+    char result = lsm6ds33_read_register(dev, reg); // confirm that it was successfully written
     return (result == data);
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #include "timer.h"
 #include "math.h"
 #include "read_angle.h"
+#include "audio_sequence.h"
 #include "assert.h"
 #include "printf.h"
 
@@ -10,11 +11,9 @@
 
 static const double UPDOWN_GESTURE_POS_ACCEL_TOP = 8000;
 static const double UPDOWN_GESTURE_POS_ACCEL_BOTTOM = 100;
+// Angular acceleration of a hit that should play at full velocity
+static const double STRIKE_ACCEL_FULL = 40000;
 
-// Constant between 0 and 1
-// For more responsiveness, increase it closer to 1
-// For more accuracy (in the long run), decrease it closer to 0
-static const double KP_angle = 0.999;
 
 static axis_t getAngleAxis(axis_t hAxis, axis_t vAxis) {
     axis_t hAx = hAxis & ~AXIS_REVERSED,
@@ -32,7 +31,18 @@ static axis_t getAngleAxis(axis_t hAxis, axis_t vAxis) {
 }
 
 
-gesture_handler_t createGestureReader(axis_t horizontal, axis_t vertical) {
+// Scales the angular acceleration that set off a hit onto 1..MAX_VELOCITY.
+// alpha only changes once a slot, so this is the highest it has been so far; the
+// hit is not held back for a later slot to see whether it climbs further, as the
+// wait (a slot, ~36 ms at 833 Hz) would make every hit late
+static unsigned int strikeVelocity(double alpha) {
+    double fraction = (alpha - UPDOWN_GESTURE_POS_ACCEL_TOP) / (STRIKE_ACCEL_FULL - UPDOWN_GESTURE_POS_ACCEL_TOP);
+    if (fraction < 0) fraction = 0;
+    if (fraction > 1) fraction = 1;
+    return 1 + (unsigned int) (fraction * (MAX_VELOCITY - 1) + 0.5);
+}
+
+gesture_handler_t createGestureReader(axis_t horizontal, axis_t vertical, unsigned int sample_period_us) {
     gesture_handler_t reader;
     reader.angle = 0;
     reader.m_lastUpdateTime = timer_get_ticks();
@@ -42,8 +52,13 @@ gesture_handler_t createGestureReader(axis_t horizontal, axis_t vertical) {
     reader.angleAxis = getAngleAxis(horizontal, vertical);
     reader.omega = 0;
     reader.alpha = 0;
+    reader.strikeVelocity = 0;
     reader.m_initialized = false;
     reader.angleBufferSamples = 0;
+    reader.angleBufferTime = 0;
+    double slot = ANGLE_BUFFER_SLOT_US * pow((double) sample_period_us / ANGLE_BUFFER_REFERENCE_PERIOD_US, 0.2);
+    reader.angleBufferSlotSamples = (unsigned int) (slot / sample_period_us + 0.5);
+    if (reader.angleBufferSlotSamples == 0) reader.angleBufferSlotSamples = 1;
     reader.calibration = 0;
     for (size_t i = 0; i < ANGLE_BUFFER_LEN; ++i) reader.angleBuffer[i] = 0;
     return reader;
@@ -80,30 +95,39 @@ static double getAngleValue(const lsm6ds33_data_t* data, axis_t axis) {
 }
 
 
-void calibrate(gesture_handler_t* reader) {
+unsigned int gestureAxes(const gesture_handler_t* reader) {
+    // X_AXIS, Y_AXIS and Z_AXIS are 0, 2 and 4, and the mask bits go X, Y, Z
+    return (LSM6DS33_ACCEL_X << ((reader->hAxis & ~AXIS_REVERSED) / 2))
+         | (LSM6DS33_ACCEL_X << ((reader->vAxis & ~AXIS_REVERSED) / 2))
+         | (LSM6DS33_GYRO_X << ((reader->angleAxis & ~AXIS_REVERSED) / 2));
+}
+
+void calibrate(gesture_handler_t* reader, lsm6ds33_dev_t* dev) {
     printf("Calibrating. Leave the stick still\n");
     const size_t numSamples = 1000;
     double total = 0;
     for (size_t i = 0; i < numSamples; ++i) {
         lsm6ds33_data_t data;
-        lsm6ds33_get_all(&data);
+        lsm6ds33_get_all(dev, &data);
         total += getAngleValue(&data, reader->angleAxis) / ((double)numSamples);
         timer_delay_ms(1);
     }
     reader->calibration = total;
 }
 
-void updateAngle(gesture_handler_t* reader, const lsm6ds33_data_t* data) {
+void updateAngle(gesture_handler_t* reader, const lsm6ds33_data_t* data, unsigned int time) {
     double x = getAxisValue(data, reader->hAxis);
     double y = getAxisValue(data, reader->vAxis);
 
     // From free body diagram
     double absoluteAngle = atan2(x, y) * DEGREES_PER_RADIAN;
-    unsigned int time = timer_get_ticks();
-    double deltaT = (time - reader->m_lastUpdateTime) / 1000000.0;  // time since last update in seconds
+    // Time since last update in seconds; the first sample has nothing before it
+    double deltaT = reader->m_initialized ? (time - reader->m_lastUpdateTime) / 1000000.0 : 0;
     double omega = getAngleValue(data, reader->angleAxis) - reader->calibration;
     double angleChange = omega * deltaT;
-    // Filtered angle
+    // Filtered angle: trusts the gyro over short times and the accel over long ones.
+    // KP is the share of the gyro, so that it's the same filter however far apart samples are
+    double KP_angle = ANGLE_FILTER_TIME / (ANGLE_FILTER_TIME + deltaT);
     if (reader->m_initialized) {
         reader->angle += KP_angle * angleChange + (1 - KP_angle) * (absoluteAngle - reader->angle);
     } else {
@@ -118,17 +142,20 @@ void updateAngle(gesture_handler_t* reader, const lsm6ds33_data_t* data) {
                 /*&& reader->angle < UPDOWN_GESTURE_LOW*/) {
         reader->gestureUpDownState = BEYOND_RANGE_NOT_FIRED;
         reader->m_lastUpDownGestureTime = time;
+        reader->strikeVelocity = strikeVelocity(reader->alpha);
     }
 
-    reader->angleBuffer[ANGLE_BUFFER_LEN - 1] += reader->angle / ANGLE_BUFFER_NUM_SAMPLES;
-    if (++reader->angleBufferSamples == ANGLE_BUFFER_NUM_SAMPLES) {
+    reader->angleBuffer[ANGLE_BUFFER_LEN - 1] += reader->angle / reader->angleBufferSlotSamples;
+    reader->angleBufferTime += deltaT;
+    if (++reader->angleBufferSamples == reader->angleBufferSlotSamples) {
         // Update alpha, omega
         // Source for coefficients: https://en.wikipedia.org/wiki/Finite_difference_coefficient#Forward_and_backward_finite_difference
         double alpha = 0, omega = 0;
         reader->angleBufferSamples = 0;
         static const double deriv2coeffs[ANGLE_BUFFER_LEN] = {-1, 4, -5, 2};
         for (size_t i = 0; i < ANGLE_BUFFER_LEN; ++i) alpha += deriv2coeffs[i] * reader->angleBuffer[i];
-        double dt = deltaT * ANGLE_BUFFER_NUM_SAMPLES;
+        double dt = reader->angleBufferTime;
+        reader->angleBufferTime = 0;
         alpha /= (dt * dt);
         static const double deriv1coeffs[ANGLE_BUFFER_LEN] = {-0.3333, 1.5, -3.0, 1.83333};
         for (size_t i = 0; i < ANGLE_BUFFER_LEN; ++i) omega += deriv1coeffs[i] * reader->angleBuffer[i];
@@ -0,0 +1,99 @@
+/*
+ * Feeds the gesture reader a simulated strike at the sensor rates main.c can
+ * run at and measures how long after the stick starts moving the hit is
+ * reported. Checks that it is reported stamped with the sample it was seen at,
+ * so the hit is never held back and triggerSequence can place it exactly, and
+ * that a harder strike gets a higher velocity.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include "read_angle.h"
+#include "audio_sequence.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL: %s (line %d)\n", #cond, __LINE__); return 1; } } while (0)
+
+// Strikes accelerate the stick at 'accel' for STRIKE_US, then stop it as fast
+#define REST_US 1000000
+#define STRIKE_US 60000
+// Longest a hit may take to show up after the strike starts. The angle buffer
+// needs a couple of slots (up to 48 ms each) of the strike to see it
+#define MAX_DETECT_US 150000
+
+unsigned int timer_get_ticks(void) { return 0; }
+void timer_delay_ms(unsigned int msecs) { }
+void lsm6ds33_get_all(lsm6ds33_dev_t *dev, lsm6ds33_data_t *data) { }
+
+static void setAxis(double *x, double *y, double *z, axis_t axis, double value)
+{
+    if (axis & AXIS_REVERSED) value = -value;
+    axis &= ~AXIS_REVERSED;
+    if (axis == X_AXIS) *x = value;
+    else if (axis == Y_AXIS) *y = value;
+    else *z = value;
+}
+
+// Angle (degrees) and angular velocity (degrees/s) 't' us after the strike starts
+static void strike(double accel, int t, double *angle, double *omega)
+{
+    double s = t / 1000000.0, up = STRIKE_US / 1000000.0;
+    if (t <= 0) {
+        *angle = *omega = 0;
+    } else if (t < STRIKE_US) {
+        *angle = accel * s * s / 2;
+        *omega = accel * s;
+    } else if (t < 2 * STRIKE_US) {
+        double d = s - up;
+        *angle = accel * up * up / 2 + accel * up * d - accel * d * d / 2;
+        *omega = accel * (up - d);
+    } else {
+        *angle = accel * up * up;
+        *omega = 0;
+    }
+}
+
+// Runs one strike through a new reader. Returns the microseconds from the start
+// of the strike to the sample the hit was reported at, or -1 if it wasn't
+static int detect(unsigned int period, double accel, unsigned int *velocity, int *stampError)
+{
+    gesture_handler_t reader = createGestureReader(X_AXIS, Z_AXIS, period);
+    for (unsigned int time = 0; time < REST_US + 4 * STRIKE_US; time += period) {
+        double angle, omega;
+        strike(accel, (int) time - REST_US, &angle, &omega);
+        lsm6ds33_data_t data = {0};
+        double rad = angle / DEGREES_PER_RADIAN;
+        setAxis(&data.accelx, &data.accely, &data.accelz, reader.hAxis, 1000 * sin(rad));
+        setAxis(&data.accelx, &data.accely, &data.accelz, reader.vAxis, 1000 * cos(rad));
+        setAxis(&data.gyrox, &data.gyroy, &data.gyroz, reader.angleAxis, omega);
+        updateAngle(&reader, &data, time);
+        if (checkUpDownGesture(&reader)) {
+            *velocity = reader.strikeVelocity;
+            *stampError = (int) (reader.m_lastUpDownGestureTime - time);
+            return (int) time - REST_US;
+        }
+    }
+    return -1;
+}
+
+int main(void)
+{
+    // Sample periods at LSM6DS33_RATE_208_HZ and LSM6DS33_RATE_833_HZ
+    static const unsigned int periods[] = {4808, 1200};
+    static const char *const names[] = {"208 Hz", "833 Hz"};
+    printf("rate    strike (deg/s^2)  reported after  velocity\n");
+    for (size_t r = 0; r < sizeof(periods) / sizeof(periods[0]); ++r) {
+        unsigned int period = periods[r];
+        unsigned int lastVelocity = 0;
+        for (double accel = 20000; accel <= 40000; accel += 10000) {
+            unsigned int velocity = 0;
+            int stampError = 0;
+            int latency = detect(period, accel, &velocity, &stampError);
+            printf("%-6s  %16.0f  %11.1f ms  %8d\n", names[r], accel, latency / 1000.0, velocity);
+            CHECK(latency >= 0 && latency <= MAX_DETECT_US);
+            CHECK(stampError == 0);
+            CHECK(velocity >= 1 && velocity <= MAX_VELOCITY && velocity >= lastVelocity);
+            lastVelocity = velocity;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef PRINTF_H
+#define PRINTF_H
+
+/*
+ * Host stand-in for the CS107E printf.h so the audio modules can be built
+ * and exercised with the native compiler.
+ */
+
+#include <stdio.h>
+
+#endif
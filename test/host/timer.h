@@ -0,0 +1,12 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+/*
+ * Host stand-in for the CS107E timer.h; the tests that need the timer
+ * define these themselves.
+ */
+
+unsigned int timer_get_ticks(void);
+void timer_delay_ms(unsigned int msecs);
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ * Host benchmark for the voice mixer. Times the average chunk at the default
+ * size (SYNTH_CHUNK_FRAMES stereo frames) for 1 to NUM_TRACKS active voices,
+ * comparing the original float gain path against the fixed-point path in
+ * audio_sequence.c, and checks that the whole mix agrees to within 1 LSB
+ * however many voices are playing. Also times the stereo kernels, which give
+ * every voice its own left and right gain, against the mono bus the mixer had
+ * before panning (one gain per voice, duplicated onto both sides when written
+ * out), and fails if stereo costs more than MAX_STEREO_RATIO times as much.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "audio_sequence.h"
+#include "mix.h"
+#include "synth.h"
+
+#define CHUNK_SIZE (2 * SYNTH_CHUNK_FRAMES)
+#define ITERATIONS 20000
+#define VOICE_LEN (CHUNK_SIZE * 4)
+// Stereo does two multiply-accumulates a sample where mono did one, and only
+// the loads and loop overhead are shared, so it can't match mono. On the host
+// (the C kernels at -O2) it measures 1.6-1.9x mono, and up to 2.3x on a busy
+// machine, which the bound allows for
+#define MAX_STEREO_RATIO 2.5
+#define KERNEL_TRIES 1000
+
+extern struct track all_tracks[NUM_TRACK_SLOTS];
+
+static int16_t voice_samples[NUM_TRACKS][VOICE_LEN];
+static const float voice_volumes[8] = {1.0, 5.0, 3.0, 0.7, 0.25, 1.5, 0.33, 2.0};
+static struct audio_sequence voice_sequences[NUM_TRACKS];
+static int voice_ids[NUM_TRACKS];
+
+static uint64_t now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+static int16_t clamp(int32_t sample)
+{
+    if (sample > INT16_MAX) return INT16_MAX;
+    else if (sample < INT16_MIN) return INT16_MIN;
+    else return (int16_t) sample;
+}
+
+// The float gain path the mixer had before gains went fixed point. That mixer
+// also truncated and clipped after every voice, so it drifted up to 1 LSB a
+// voice from the float gains; here the voices are summed in float and rounded
+// once, the way the fixed-point bus is, so the two can be held to 1 LSB
+static bool dumpMusicFloat(struct track *track, float *bus, size_t frames)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        if (track->index < track->seq->len) {
+            const struct audio_file *aud = &track->seq->audios[track->index];
+            if (aud->audio_samples != NULL) {
+                bus[i] += aud->audio_samples[track->position] * aud->volume;
+            }
+            if (++track->position == aud->audio_len) {
+                track->index++;
+                track->position = 0;
+            }
+        } else return true;
+    }
+    return track->index >= track->seq->len;
+}
+
+static void dumpAllTracksFloat(int16_t *buf, size_t buflen)
+{
+    static float bus[CHUNK_SIZE / 2];
+    size_t frames = buflen / 2;
+    for (size_t i = 0; i < frames; ++i) bus[i] = 0;
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) {
+        if (all_tracks[i].isRunning && dumpMusicFloat(&all_tracks[i], bus, frames)) {
+            all_tracks[i].isRunning = false;
+        }
+    }
+    for (size_t i = 0; i < frames; ++i) buf[2*i] = buf[2*i+1] = clamp(lrintf(bus[i]));
+}
+
+static void registerVoices(void)
+{
+    for (size_t v = 0; v < NUM_TRACKS; ++v) {
+        struct audio_sequence *seq = &voice_sequences[v];
+        seq->len = 0;
+        // Split each voice around a gap of silence so runs end mid-chunk
+        size_t split = 1000 + 111 * v;
+        seq->audios[seq->len++] = createAudio(voice_samples[v], split, voice_volumes[v % 8]);
+        seq->audios[seq->len++] = createAudio(NULL, 700 + 37 * v, 0.0);
+        seq->audios[seq->len++] = createAudio(voice_samples[v] + split, VOICE_LEN - split, voice_volumes[v % 8]);
+        voice_ids[v] = registerSequence(seq);
+    }
+}
+
+// Leaves the first 'nvoices' voices playing from the start
+static void startVoices(size_t nvoices)
+{
+    static int16_t buf[2];
+    static int32_t bus[2];
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) all_tracks[i].isRunning = false;
+    for (size_t v = 0; v < nvoices; ++v) triggerSequence(voice_ids[v], AUDIO_GAIN_ONE, PAN_CENTER, 0);
+    // Triggers start at the next chunk, so run an empty one to pick them up
+    dumpAllTracks(buf, bus, 0, 0);
+}
+
+static void dumpAllTracksFixed(int16_t *buf, size_t buflen)
+{
+    static int32_t bus[CHUNK_SIZE];
+    dumpAllTracks(buf, bus, buflen, 0);
+}
+
+static uint64_t timeChunks(void (*dump)(int16_t *, size_t), size_t nvoices)
+{
+    static int16_t buf[CHUNK_SIZE];
+    uint64_t total = 0;
+    for (size_t iter = 0; iter < ITERATIONS; ++iter) {
+        if (iter % (VOICE_LEN * 2 / CHUNK_SIZE) == 0) startVoices(nvoices);
+        uint64_t start = now();
+        dump(buf, CHUNK_SIZE);
+        total += now() - start;
+    }
+    return total / ITERATIONS;
+}
+
+// The mono bus from before panning: one gain per voice, and each mixed sample
+// written to both sides
+static void monoAccumulate(int32_t *bus, const int16_t *samples, size_t frames, int32_t gain)
+{
+    gain <<= MIX_FRAC_BITS;
+    for (size_t i = 0; i < frames; ++i) {
+        bus[i] += (int32_t) (((int64_t) samples[i] * gain) >> AUDIO_GAIN_SHIFT);
+    }
+}
+
+static void monoWrite(int16_t *buf, const int32_t *bus, size_t frames)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        buf[2*i] = buf[2*i+1] = clamp((bus[i] + (1 << (MIX_FRAC_BITS - 1))) >> MIX_FRAC_BITS);
+    }
+}
+
+// Fastest chunk of 'nvoices' voices through the mono and the stereo kernels,
+// taking turns so time the host spends elsewhere falls on both alike
+static void timeKernels(size_t nvoices, uint64_t *monoTime, uint64_t *stereoTime)
+{
+    static int16_t buf[CHUNK_SIZE];
+    static int32_t bus[CHUNK_SIZE];
+    const size_t frames = CHUNK_SIZE / 2;
+    *monoTime = *stereoTime = UINT64_MAX;
+    for (size_t try = 0; try < KERNEL_TRIES; ++try) {
+        const int16_t *samples = voice_samples[0] + (try % 4) * frames;
+        uint64_t start = now();
+        for (size_t i = 0; i < frames; ++i) bus[i] = 0;
+        for (size_t v = 0; v < nvoices; ++v) monoAccumulate(bus, samples, frames, AUDIO_GAIN_ONE);
+        monoWrite(buf, bus, frames);
+        uint64_t time = now() - start;
+        if (time < *monoTime) *monoTime = time;
+
+        start = now();
+        for (size_t i = 0; i < 2 * frames; ++i) bus[i] = 0;
+        for (size_t v = 0; v < nvoices; ++v) mix_accumulate(bus, samples, frames, AUDIO_GAIN_ONE, AUDIO_GAIN_ONE / 2);
+        mix_write(buf, bus, frames);
+        time = now() - start;
+        if (time < *stereoTime) *stereoTime = time;
+    }
+}
+
+static int maxError(size_t nvoices)
+{
+    static int16_t expected[CHUNK_SIZE], actual[CHUNK_SIZE];
+    int worst = 0;
+    startVoices(nvoices);
+    struct track saved[NUM_TRACK_SLOTS];
+    for (size_t chunk = 0; chunk < VOICE_LEN * 3 / CHUNK_SIZE; ++chunk) {
+        for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) saved[i] = all_tracks[i];
+        dumpAllTracksFloat(expected, CHUNK_SIZE);
+        for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) all_tracks[i] = saved[i];
+        dumpAllTracksFixed(actual, CHUNK_SIZE);
+        for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+            int err = abs(expected[i] - actual[i]);
+            if (err > worst) worst = err;
+        }
+    }
+    return worst;
+}
+
+int main(void)
+{
+    srand(107);
+    // Keep the sum of the voices mostly inside int16 so clipping doesn't hide errors
+    for (size_t v = 0; v < NUM_TRACKS; ++v)
+        for (size_t i = 0; i < VOICE_LEN; ++i)
+            voice_samples[v][i] = (rand() % 4096) - 2048;
+    registerVoices();
+
+    int failed = 0;
+    printf("voices  float (cycles/chunk)  fixed (cycles/chunk)  speedup  max err\n");
+    for (size_t nvoices = 1; nvoices <= NUM_TRACKS; ++nvoices) {
+        uint64_t floatTime = timeChunks(dumpAllTracksFloat, nvoices);
+        uint64_t fixedTime = timeChunks(dumpAllTracksFixed, nvoices);
+        int err = maxError(nvoices);
+        printf("%6zu  %20llu  %20llu  %6.2fx  %7d\n", nvoices, (unsigned long long) floatTime,
+               (unsigned long long) fixedTime, (double) floatTime / fixedTime, err);
+        if (err > 1) failed = 1;
+    }
+    if (failed) printf("FAIL: fixed-point mix differs from the float mix by more than 1 LSB\n");
+
+    printf("\nvoices  mono (cycles/chunk)  stereo (cycles/chunk)  ratio\n");
+    for (size_t nvoices = 1; nvoices <= NUM_TRACKS; ++nvoices) {
+        uint64_t monoTime, stereoTime;
+        timeKernels(nvoices, &monoTime, &stereoTime);
+        double ratio = (double) stereoTime / monoTime;
+        printf("%6zu  %19llu  %21llu  %5.2f\n", nvoices, (unsigned long long) monoTime,
+               (unsigned long long) stereoTime, ratio);
+        if (ratio > MAX_STEREO_RATIO) {
+            printf("FAIL: stereo voices cost more than %.2fx mono ones\n", MAX_STEREO_RATIO);
+            failed = 1;
+        }
+    }
+    return failed;
+}
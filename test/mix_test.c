@@ -0,0 +1,90 @@
+/*
+ * Checks that the ARMv6 mixing kernels produce exactly the same output as the
+ * C reference kernels on randomized voice sets: random gains (including gains
+ * well above 1.0 that clip, and different gains on each side), odd and even
+ * sample alignments and run lengths.
+ * Also checks that the mix doesn't depend on the order voices are added in.
+ * On the host the ARMv6 instructions are emulated, see mix.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "audio_sequence.h"
+#include "mix.h"
+
+#define MAX_FRAMES 1024
+#define MAX_VOICES 16
+#define TRIALS 2000
+
+static int16_t samples[MAX_VOICES][MAX_FRAMES + 1];
+static int32_t expectedBus[2 * MAX_FRAMES], actualBus[2 * MAX_FRAMES], reversedBus[2 * MAX_FRAMES];
+static int16_t expected[2 * MAX_FRAMES] __attribute__((aligned(4)));
+static int16_t actual[2 * MAX_FRAMES] __attribute__((aligned(4)));
+static int16_t reversed[2 * MAX_FRAMES] __attribute__((aligned(4)));
+
+struct voice {
+    size_t offset, start, frames;
+    int32_t gainL, gainR;
+};
+
+static bool differs(const int16_t *a, const int16_t *b, const char *what, size_t trial)
+{
+    for (size_t i = 0; i < 2 * MAX_FRAMES; ++i) {
+        if (a[i] != b[i]) {
+            printf("FAIL: trial %zu, element %zu: reference %d, %s %d\n", trial, i, a[i], what, b[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+static int16_t randomSample(void)
+{
+    return (int16_t) (rand() & 0xffff);
+}
+
+int main(void)
+{
+    srand(107);
+    for (size_t trial = 0; trial < TRIALS; ++trial) {
+        for (size_t v = 0; v < MAX_VOICES; ++v)
+            for (size_t i = 0; i < MAX_FRAMES + 1; ++i)
+                samples[v][i] = randomSample();
+
+        // Start from whatever a previous voice might have left on the bus
+        for (size_t i = 0; i < 2 * MAX_FRAMES; ++i)
+            expectedBus[i] = actualBus[i] = reversedBus[i] = randomSample() / 4;
+
+        struct voice voices[MAX_VOICES];
+        size_t nvoices = 1 + rand() % MAX_VOICES;
+        for (size_t v = 0; v < nvoices; ++v) {
+            voices[v].offset = rand() % 2;
+            voices[v].start = rand() % MAX_FRAMES;
+            voices[v].frames = rand() % (MAX_FRAMES - voices[v].start + 1);
+            voices[v].gainL = rand() % (6 * AUDIO_GAIN_ONE);
+            // Mostly panned, sometimes centred or hard to one side
+            switch (rand() % 4) {
+                case 0: voices[v].gainR = voices[v].gainL; break;
+                case 1: voices[v].gainR = 0; break;
+                default: voices[v].gainR = rand() % (6 * AUDIO_GAIN_ONE); break;
+            }
+        }
+        for (size_t v = 0; v < nvoices; ++v) {
+            const struct voice *f = &voices[v], *r = &voices[nvoices - 1 - v];
+            mix_accumulate_c(&expectedBus[2 * f->start], &samples[v][f->offset], f->frames, f->gainL, f->gainR);
+            mix_accumulate_armv6(&actualBus[2 * f->start], &samples[v][f->offset], f->frames, f->gainL, f->gainR);
+            mix_accumulate_c(&reversedBus[2 * r->start], &samples[nvoices - 1 - v][r->offset], r->frames,
+                             r->gainL, r->gainR);
+        }
+        // Odd trials leave the last frame alone, to cover the kernels' odd tail
+        size_t writeFrames = MAX_FRAMES - (trial & 1);
+        mix_write_c(expected, expectedBus, writeFrames);
+        mix_write_armv6(actual, actualBus, writeFrames);
+        mix_write_c(reversed, reversedBus, writeFrames);
+
+        if (differs(expected, actual, "armv6", trial) || differs(expected, reversed, "reversed order", trial))
+            return 1;
+    }
+    printf("mix_test: ARMv6 and reference kernels agree on %d random voice sets\n", TRIALS);
+    return 0;
+}
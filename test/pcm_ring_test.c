@@ -0,0 +1,74 @@
+/*
+ * Checks the render-ahead ring: the producer can only get 'depth' chunks
+ * ahead, chunks come out in order with their lengths, a chunk that was read
+ * isn't written again until the second read after it (by then its bulk
+ * transfer has finished), and the fill, underrun and full-tick counters add up.
+ */
+
+#include <stdio.h>
+#include "pcm_ring.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL: %s (line %d)\n", #cond, __LINE__); return 1; } } while (0)
+
+static unsigned int written, read;
+
+static void produce(void)
+{
+    if (pcm_ring_space() == 0) pcm_ring_count_full_tick();
+    for (unsigned int n = pcm_ring_space(); n > 0; --n) {
+        int16_t *slot = pcm_ring_write_slot();
+        slot[0] = written;
+        pcm_ring_commit(2 + 2 * (written++ % 4));
+    }
+}
+
+int main(void)
+{
+    struct pcm_ring_stats stats;
+    size_t len;
+
+    CHECK(!pcm_ring_set_depth(0) && !pcm_ring_set_depth(PCM_RING_MAX_DEPTH + 1));
+    CHECK(pcm_ring_get_depth() == PCM_RING_DEPTH);
+    CHECK(pcm_ring_read(&len) == NULL);
+
+    for (unsigned int depth = 1; depth <= PCM_RING_MAX_DEPTH; ++depth) {
+        CHECK(pcm_ring_set_depth(depth));
+        // Drain what the previous depth left, then fill up
+        while (pcm_ring_read(&len) != NULL) read++;
+        pcm_ring_reset_stats();
+        produce();
+        pcm_ring_get_stats(&stats);
+        CHECK(stats.fill == depth && stats.rendered == depth);
+        produce();
+        pcm_ring_get_stats(&stats);
+        CHECK(stats.fullTicks == 1);
+
+        // Read one at a time, refilling in between, and check that neither
+        // this chunk nor the one read before it has been overwritten
+        const int16_t *recent[2] = {NULL, NULL};
+        int16_t recentValue[2] = {0, 0};
+        for (unsigned int i = 0; i < 50; ++i) {
+            const int16_t *chunk = pcm_ring_read(&len);
+            CHECK(chunk != NULL);
+            CHECK(chunk[0] == (int16_t) read && len == 2 + 2 * (read % 4));
+            read++;
+            recent[1] = recent[0]; recentValue[1] = recentValue[0];
+            recent[0] = chunk; recentValue[0] = chunk[0];
+            produce();
+            for (int k = 0; k < 2; ++k) CHECK(recent[k] == NULL || recent[k][0] == recentValue[k]);
+        }
+        pcm_ring_get_stats(&stats);
+        CHECK(stats.minFill == depth && stats.underruns == 0);
+    }
+
+    // Draining past empty counts underruns
+    pcm_ring_reset_stats();
+    while (pcm_ring_read(&len) != NULL) read++;
+    CHECK(pcm_ring_read(&len) == NULL);
+    pcm_ring_get_stats(&stats);
+    CHECK(stats.fill == 0 && stats.minFill == 0 && stats.underruns == 2);
+    CHECK(read == written);
+
+    printf("pcm_ring_test: %d chunks through depths 1 to %d\n", written, PCM_RING_MAX_DEPTH);
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * Checks the load-time resampler's frequency response both ways between
+ * 44.1 kHz and 48 kHz: tones up to PASSBAND_HZ come through within 0.1 dB, the
+ * images left over from upsampling and the aliases of tones the lower rate
+ * can't hold are at least MIN_REJECTION_DB down, DC comes through exactly, and
+ * the output lines up with the input. Also checks that loadAudio resamples a
+ * recording only once, and times the resampler in output samples per second.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "audio_sequence.h"
+#include "resample.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL: %s (line %d)\n", #cond, __LINE__); return 1; } } while (0)
+
+#define TONE_LEN 16384
+#define AMPLITUDE 16000
+#define PASSBAND_HZ 17000
+#define MIN_REJECTION_DB 75
+// Long enough that the filter's warm-up at either end stays out of the measurement
+#define EDGE RESAMPLE_TAPS
+#define BENCH_SECONDS 10
+
+static int16_t in[BENCH_SECONDS * 48000];
+static int16_t out[BENCH_SECONDS * 48000 + 1];
+
+static void makeTone(int16_t *buf, size_t len, double freq, unsigned int rate)
+{
+    for (size_t i = 0; i < len; ++i) buf[i] = (int16_t) lrint(AMPLITUDE * sin(2 * M_PI * freq * i / rate));
+}
+
+// Level of 'freq' in buf[EDGE..len-EDGE), in dB relative to AMPLITUDE, from a
+// Hann-windowed DFT at that one frequency
+static double level(const int16_t *buf, size_t len, double freq, unsigned int rate)
+{
+    size_t n = len - 2 * EDGE;
+    double re = 0, im = 0, windowSum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        double w = 0.5 - 0.5 * cos(2 * M_PI * i / n);
+        double phase = 2 * M_PI * freq * (i + EDGE) / rate;
+        re += w * buf[i + EDGE] * cos(phase);
+        im += w * buf[i + EDGE] * sin(phase);
+        windowSum += w;
+    }
+    double amplitude = 2 * sqrt(re * re + im * im) / windowSum;
+    return 20 * log10(amplitude / AMPLITUDE + 1e-12);
+}
+
+// Runs a tone at 'freq' through 'r' and returns the level of 'at' in the output
+static double response(const struct resampler *r, unsigned int in_rate, unsigned int out_rate, double freq, double at)
+{
+    makeTone(in, TONE_LEN, freq, in_rate);
+    resample_run(r, in, TONE_LEN, out);
+    return level(out, resample_output_len(r, TONE_LEN), at, out_rate);
+}
+
+// Where a tone at 'freq' ends up once sampled at 'rate'
+static double folded(double freq, unsigned int rate)
+{
+    freq = fmod(freq, rate);
+    return freq > rate / 2.0 ? rate - freq : freq;
+}
+
+static int checkDirection(unsigned int in_rate, unsigned int out_rate)
+{
+    struct resampler r;
+    CHECK(resample_init(&r, in_rate, out_rate));
+    CHECK(resample_output_len(&r, in_rate) == out_rate);
+
+    double worstPassband = 0;
+    for (double freq = 50; freq <= PASSBAND_HZ; freq += 250) {
+        double db = response(&r, in_rate, out_rate, freq, freq);
+        if (fabs(db) > fabs(worstPassband)) worstPassband = db;
+    }
+
+    // Upsampling leaves images of each tone around multiples of the input
+    // rate; downsampling folds tones above the output's Nyquist frequency back
+    double worstRejection = 1000;
+    if (out_rate > in_rate) {
+        static const double tones[] = {1000, 5000, 10000, 15000};
+        for (size_t i = 0; i < sizeof(tones) / sizeof(tones[0]); ++i) {
+            double image = folded(in_rate - tones[i], out_rate);
+            double db = -response(&r, in_rate, out_rate, tones[i], image);
+            if (db < worstRejection) worstRejection = db;
+        }
+    } else {
+        for (double freq = out_rate / 2.0 + 200; freq < in_rate / 2.0; freq += 300) {
+            double db = -response(&r, in_rate, out_rate, freq, folded(freq, out_rate));
+            if (db < worstRejection) worstRejection = db;
+        }
+    }
+
+    // DC comes through unchanged, not rippling at the phase rate
+    for (size_t i = 0; i < TONE_LEN; ++i) in[i] = 12345;
+    resample_run(&r, in, TONE_LEN, out);
+    for (size_t i = EDGE; i < resample_output_len(&r, TONE_LEN) - EDGE; ++i) CHECK(out[i] == 12345);
+
+    // An impulse comes out centred on the matching output time
+    for (size_t i = 0; i < TONE_LEN; ++i) in[i] = 0;
+    in[TONE_LEN / 2] = AMPLITUDE;
+    resample_run(&r, in, TONE_LEN, out);
+    size_t peak = 0;
+    for (size_t i = 0; i < resample_output_len(&r, TONE_LEN); ++i)
+        if (out[i] > out[peak]) peak = i;
+    double expected = (double) (TONE_LEN / 2) * out_rate / in_rate;
+    CHECK(fabs(peak - expected) <= 1);
+
+    printf("resample_test: %5d -> %5d Hz, %d/%d phases: passband within %.3f dB up to %d Hz, "
+           "images/aliases %.1f dB down\n", in_rate, out_rate, r.up, r.down, fabs(worstPassband),
+           PASSBAND_HZ, worstRejection);
+    CHECK(fabs(worstPassband) < 0.1);
+    CHECK(worstRejection > MIN_REJECTION_DB);
+    resample_free(&r);
+    return 0;
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int benchmark(unsigned int in_rate, unsigned int out_rate)
+{
+    struct resampler r;
+    double start = seconds();
+    CHECK(resample_init(&r, in_rate, out_rate));
+    double designTime = seconds() - start;
+
+    size_t len = BENCH_SECONDS * in_rate;
+    for (size_t i = 0; i < len; ++i) in[i] = (rand() % 4096) - 2048;
+    start = seconds();
+    resample_run(&r, in, len, out);
+    double runTime = seconds() - start;
+
+    size_t produced = resample_output_len(&r, len);
+    printf("resample_test: %5d -> %5d Hz: filter design %.2f ms, %.1f M output samples/s (%.0fx real time)\n",
+           in_rate, out_rate, designTime * 1e3, produced / runTime / 1e6, BENCH_SECONDS / runTime);
+    resample_free(&r);
+    return 0;
+}
+
+static int checkLoading(void)
+{
+    for (size_t i = 0; i < TONE_LEN; ++i) in[i] = i;
+    setOutputRate(48000);
+    struct audio_file first = loadAudio(in, TONE_LEN, 44100, 1.0);
+    struct audio_file again = loadAudio(in, TONE_LEN, 44100, 2.0);
+    CHECK(first.audio_samples != in && first.audio_len == (TONE_LEN * 160 + 146) / 147);
+    CHECK(again.audio_samples == first.audio_samples && again.gain == 2 * AUDIO_GAIN_ONE);
+    // Recordings already at the output rate, and silence, are used as they are
+    CHECK(loadAudio(in, TONE_LEN, 48000, 1.0).audio_samples == in);
+    CHECK(loadAudio(NULL, 100, 44100, 0.0).audio_len == 100);
+    // A new output rate needs a new copy
+    setOutputRate(44100);
+    CHECK(loadAudio(in, TONE_LEN, 48000, 1.0).audio_len == (TONE_LEN * 147 + 159) / 160);
+    setOutputRate(SAMPLE_RATE);
+    return 0;
+}
+
+int main(void)
+{
+    srand(107);
+    if (checkDirection(44100, 48000) || checkDirection(48000, 44100) || checkLoading()) return 1;
+    return benchmark(44100, 48000) || benchmark(48000, 44100);
+}
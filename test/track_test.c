@@ -0,0 +1,143 @@
+/*
+ * Checks track allocation when polyphony runs out: the extra triggers steal
+ * running tracks, stolen tracks fade out within TRACK_RELEASE_FRAMES, and
+ * triggers are only dropped once the release slots are busy too, and tracks
+ * that haven't started yet are dropped rather than faded. Also checks
+ * that a trigger starts at the frame matching its timestamp, even in a later
+ * chunk, and is panned, that the velocity curve rises steadily to unity gain,
+ * and that instruments pick their layer by velocity and cycle through its
+ * alternatives.
+ */
+
+#include <stdio.h>
+#include "audio_sequence.h"
+#include "instrument.h"
+
+#define CHUNK_SIZE 800
+#define VOICE_LEN 44100
+
+extern struct track all_tracks[NUM_TRACK_SLOTS];
+
+static int16_t samples[VOICE_LEN];
+static struct audio_sequence sequence, layers[3];
+
+static int16_t buf[CHUNK_SIZE] __attribute__((aligned(4)));
+static int32_t bus[CHUNK_SIZE];
+
+static size_t countTracks(bool releasing)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i)
+        if (all_tracks[i].isRunning && all_tracks[i].isReleasing == releasing) n++;
+    return n;
+}
+
+// Runs an empty chunk so a queued trigger starts, and returns what it started
+static const struct audio_sequence *startedSequence(void)
+{
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) all_tracks[i].isRunning = false;
+    dumpAllTracks(buf, bus, 0, 0);
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i)
+        if (all_tracks[i].isRunning) return all_tracks[i].seq;
+    return NULL;
+}
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL: %s (line %d)\n", #cond, __LINE__); return 1; } } while (0)
+
+int main(void)
+{
+    for (size_t i = 0; i < VOICE_LEN; ++i) samples[i] = (i % 100) * 100 - 5000;
+    sequence.len = 0;
+    sequence.audios[sequence.len++] = createAudio(samples, VOICE_LEN, 1.0);
+    int id = registerSequence(&sequence);
+    CHECK(id >= 0);
+
+    // Fill every track, one per chunk so they all have different ages
+    for (size_t i = 0; i < NUM_TRACKS; ++i) {
+        CHECK(triggerSequence(id, AUDIO_GAIN_ONE, PAN_CENTER, 0));
+        dumpAllTracks(buf, bus, CHUNK_SIZE, 0);
+    }
+    struct track_stats stats;
+    getTrackStats(&stats);
+    CHECK(stats.started == NUM_TRACKS && stats.stolen == 0 && stats.dropped == 0);
+
+    // One more than there are release slots: the last one has nowhere to go
+    for (size_t i = 0; i < TRACK_RELEASE_SLOTS + 1; ++i)
+        CHECK(triggerSequence(id, AUDIO_GAIN_ONE, PAN_CENTER, 0));
+    dumpAllTracks(buf, bus, 2 * TRACK_RELEASE_STEP, 0);
+    getTrackStats(&stats);
+    CHECK(stats.stolen == TRACK_RELEASE_SLOTS);
+    CHECK(stats.dropped == 1);
+    CHECK(countTracks(false) == NUM_TRACKS);
+    CHECK(countTracks(true) == TRACK_RELEASE_SLOTS);
+
+    // The stolen tracks are gone once the fade has played out
+    dumpAllTracks(buf, bus, 2 * TRACK_RELEASE_FRAMES, 0);
+    CHECK(countTracks(true) == 0);
+    CHECK(countTracks(false) == NUM_TRACKS);
+
+    // Tracks still waiting for their frame are dropped when stolen, not faded in
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) all_tracks[i].isRunning = false;
+    for (size_t i = 0; i < NUM_TRACKS + 1; ++i)
+        CHECK(triggerSequence(id, AUDIO_GAIN_ONE, PAN_CENTER, 500000));
+    dumpAllTracks(buf, bus, CHUNK_SIZE, 0);
+    for (size_t i = 0; i < CHUNK_SIZE; ++i) CHECK(buf[i] == 0);
+    getTrackStats(&stats);
+    CHECK(stats.stolen == TRACK_RELEASE_SLOTS + 1 && stats.dropped == 1);
+    CHECK(countTracks(true) == 0);
+    CHECK(countTracks(false) == NUM_TRACKS);
+
+    // A hit stamped 5 ms after a chunk's start begins 5 ms into it
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) all_tracks[i].isRunning = false;
+    CHECK(triggerSequence(id, AUDIO_GAIN_ONE, PAN_CENTER, 1000 + 5000));
+    dumpAllTracks(buf, bus, CHUNK_SIZE, 1000);
+    size_t expectedStart = 5000 * SAMPLE_RATE / 1000000;
+    for (size_t i = 0; i < expectedStart; ++i) CHECK(buf[2 * i] == 0);
+    CHECK(buf[2 * expectedStart] == samples[0]);
+    CHECK(buf[2 * expectedStart + 2] == samples[1]);
+
+    // One stamped past the end of the chunk waits for its frame in the next
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) all_tracks[i].isRunning = false;
+    unsigned int chunkMicros = (CHUNK_SIZE / 2) * 1000000 / SAMPLE_RATE;
+    CHECK(triggerSequence(id, AUDIO_GAIN_ONE, PAN_CENTER, 1000 + chunkMicros + 2000));
+    dumpAllTracks(buf, bus, CHUNK_SIZE, 1000);
+    for (size_t i = 0; i < CHUNK_SIZE; ++i) CHECK(buf[i] == 0);
+    dumpAllTracks(buf, bus, CHUNK_SIZE, 1000 + chunkMicros);
+    expectedStart = (uint64_t) (chunkMicros + 2000) * SAMPLE_RATE / 1000000 - CHUNK_SIZE / 2;
+    for (size_t i = 0; i < expectedStart; ++i) CHECK(buf[2 * i] == 0);
+    CHECK(buf[2 * expectedStart] == samples[0]);
+
+    // Hard left is silent on the right; centre matches on both sides
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) all_tracks[i].isRunning = false;
+    CHECK(triggerSequence(id, AUDIO_GAIN_ONE, PAN_LEFT, 0));
+    dumpAllTracks(buf, bus, CHUNK_SIZE, 0);
+    for (size_t i = 0; i < CHUNK_SIZE / 2; ++i) CHECK(buf[2 * i + 1] == 0);
+    CHECK(buf[0] != 0);
+    for (size_t i = 0; i < NUM_TRACK_SLOTS; ++i) all_tracks[i].isRunning = false;
+    CHECK(triggerSequence(id, AUDIO_GAIN_ONE, PAN_CENTER, 0));
+    dumpAllTracks(buf, bus, CHUNK_SIZE, 0);
+    for (size_t i = 0; i < CHUNK_SIZE / 2; ++i) CHECK(buf[2 * i] == buf[2 * i + 1] && buf[2 * i] == samples[i]);
+
+    // A hard hit plays at unity, the softest one 24 dB down, and harder is never quieter
+    CHECK(velocityGain(MAX_VELOCITY) == AUDIO_GAIN_ONE && velocityGain(MAX_VELOCITY + 50) == AUDIO_GAIN_ONE);
+    CHECK(velocityGain(1) > AUDIO_GAIN_ONE / 16 && velocityGain(1) < AUDIO_GAIN_ONE / 15);
+    for (unsigned int v = 1; v <= MAX_VELOCITY; ++v) CHECK(velocityGain(v) > velocityGain(v - 1));
+
+    // Two soft alternatives alternate; hard hits get their own layer
+    struct instrument inst;
+    initInstrument(&inst);
+    for (size_t i = 0; i < 3; ++i) {
+        layers[i].len = 0;
+        layers[i].audios[layers[i].len++] = createAudio(samples, VOICE_LEN, 1.0);
+        CHECK(addInstrumentSample(&inst, i < 2 ? 20 : 100, registerSequence(&layers[i])));
+    }
+    CHECK(!addInstrumentSample(&inst, 50, id));
+    CHECK(triggerInstrument(&inst, 1, PAN_CENTER, 0) && startedSequence() == &layers[0]);
+    CHECK(triggerInstrument(&inst, 99, PAN_CENTER, 0) && startedSequence() == &layers[1]);
+    CHECK(triggerInstrument(&inst, 60, PAN_CENTER, 0) && startedSequence() == &layers[0]);
+    CHECK(triggerInstrument(&inst, 100, PAN_CENTER, 0) && startedSequence() == &layers[2]);
+    CHECK(triggerInstrument(&inst, MAX_VELOCITY, PAN_CENTER, 0) && startedSequence() == &layers[2]);
+
+    printf("track_test: %d tracks, stolen=%d dropped=%d\n", NUM_TRACKS, stats.stolen, stats.dropped);
+    return 0;
+}